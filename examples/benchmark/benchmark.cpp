@@ -0,0 +1,52 @@
+/* Cost of one push() + median() on full buffer, for each order index (figures in README.md).
+   Host program, not a sketch:
+
+   g++ -std=c++11 -O2 -I../.. benchmark.cpp -o benchmark && ./benchmark
+   */
+
+#include "qmedianbuffer.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+//ns per push() + median(), values 0 .. range - 1, buffer filled first
+template<typename T, template<typename, typename> class indexT, typename sizeT>
+double measure(sizeT capacity, uint32_t range){
+	qmedianbuffer<T, uint32_t, float, indexT, sizeT> buf(capacity);
+	std::mt19937 rng(1);
+	volatile uint32_t sink = 0;
+	for (uint32_t i = 0; i < capacity; i++) buf.push(rng() % range, i);
+
+	uint32_t rounds = 2000000 / capacity + 2000;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < rounds; i++){
+		buf.push(rng() % range, i);
+		sink += buf.median();
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / rounds;
+}
+
+int main(){
+	const uint8_t capacities[] = { 5, 31, 127, 255 };
+	printf("uint16_t values 0..999, default uint8_t size type:\n\n");
+	printf("| capacity | qnoindex | qsortedindex | qheapindex | qrankindex |\n");
+	printf("|---------:|---------:|-------------:|-----------:|-----------:|\n");
+	for (uint8_t capacity : capacities){
+		printf("| %-8u | %-8.0f | %-12.0f | %-10.0f | %-10.0f |\n", capacity,
+			measure<uint16_t, qnoindex>(capacity, 1000), measure<uint16_t, qsortedindex>(capacity, 1000),
+			measure<uint16_t, qheapindex>(capacity, 1000), measure<uint16_t, qrankindex>(capacity, 1000));
+	}
+
+	//histogram index against heaps, for windows bigger then 255 entries
+	const uint16_t bigCapacities[] = { 5, 31, 255, 1000 };
+	printf("\nuint8_t values 0..255 / uint16_t values 0..999, uint16_t size type:\n\n");
+	printf("| capacity | u8 qhistindex | u8 qheapindex | u16 qhistindex | u16 qheapindex |\n");
+	printf("|---------:|--------------:|--------------:|---------------:|---------------:|\n");
+	for (uint16_t capacity : bigCapacities){
+		printf("| %-8u | %-13.0f | %-13.0f | %-14.0f | %-14.0f |\n", capacity,
+			measure<uint8_t, qhistindex>(capacity, 256), measure<uint8_t, qheapindex>(capacity, 256),
+			measure<uint16_t, qhistindex>(capacity, 1000), measure<uint16_t, qheapindex>(capacity, 1000));
+	}
+	return 0;
+}
@@ -0,0 +1,303 @@
+/* Checks of qmedianbuffer results against plain computation; prints failures, returns their count.
+   Host program, not a sketch:
+
+   g++ -std=c++11 -O2 -I../.. check.cpp -o check && ./check
+   */
+
+#include "qmedianbuffer.h"
+#include "qmultimedianbuffer.h"
+#include "qsketchmedianbuffer.h"
+#include "qp2medianbuffer.h"
+#include "qshardedmedianbuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static int failures = 0;
+
+#define CHECK(condition) do { if (!(condition)){ printf("FAILED: %s (line %d)\n", #condition, __LINE__); failures++; } } while (0)
+
+static bool near(double a, double b){
+	return std::fabs(a - b) <= 1e-6 * (std::fabs(b) + 1);
+}
+
+//window spans more then range of narrow <timeT>, intervals do not
+static void checkWrappingTime(){
+	qmedianbuffer<uint16_t, uint8_t, double> buf(10);
+	uint8_t now = 0;
+	for (int i = 0; i < 10; i++){
+		buf.push(i, now);
+		now += 50;
+	}
+	CHECK(near(buf.averageInterval(), 50));
+	CHECK(near(buf.averageRateOfChange(), 1.0 / 50));
+
+	//the same after oldest entries are overwritten, popped, and pushed as batch
+	for (int i = 0; i < 25; i++){
+		buf.push(i, now);
+		now += 50;
+	}
+	CHECK(near(buf.averageInterval(), 50));
+	buf.pop();
+	buf.pop();
+	CHECK(near(buf.averageInterval(), 50));
+	uint16_t batch[7] = { 1, 2, 3, 4, 5, 6, 7 };
+	buf.pushMany(batch, 7, now, 50);
+	now += 7 * 50;
+	CHECK(near(buf.averageInterval(), 50));
+	buf.pushMany(batch, 7, now, 30);
+	CHECK(near(buf.averageInterval(), (3.0 * 50 + 6.0 * 30) / 9)); //3 older entries stay, first of batch is 50 after them
+
+	qmedianbuffer<uint16_t, uint8_t, double, qnoindex, uint8_t> tracked(10, QMEDIANBUFFER_TRACK_INTERVALS);
+	now = 0;
+	for (int i = 0; i < 30; i++){
+		tracked.push(i, now);
+		now += 50;
+	}
+	CHECK(near(tracked.averageInterval(), 50));
+	CHECK(near(tracked.medianInterval(), 50));
+
+	qmultimedianbuffer<uint16_t, uint8_t, double> multi(10, 3);
+	uint16_t row[3] = { 1, 2, 3 };
+	now = 0;
+	for (int i = 0; i < 25; i++){
+		multi.push(row, now);
+		now += 50;
+	}
+	CHECK(near(multi.averageInterval(), 50));
+	multi.pop();
+	CHECK(near(multi.averageInterval(), 50));
+	multi.clear();
+	multi.push(row, now);
+	multi.push(row, (uint8_t)(now + 20));
+	CHECK(near(multi.averageInterval(), 20));
+
+	//whole stream, many times the range of <timeT>
+	qsketchmedianbuffer<uint16_t, uint16_t, double> sketch(50), other(50);
+	uint16_t millis = 0;
+	for (int i = 0; i < 100000; i++){
+		sketch.push(i % 100, millis);
+		other.push(i % 100, millis);
+		millis += 5;
+	}
+	CHECK(near(sketch.averageInterval(), 5));
+	CHECK(near(sketch.averageRateOfChange(), 0.2));
+	sketch.merge(other);
+	CHECK(near(sketch.averageInterval(), 5));
+	uint8_t bytes[4096];
+	qsketchmedianbuffer<uint16_t, uint16_t, double> copy(50);
+	CHECK(sketch.serializedSize() <= sizeof(bytes));
+	CHECK(copy.deserialize(bytes, sketch.serialize(bytes)));
+	CHECK(near(copy.averageInterval(), 5));
+
+	qp2medianbuffer<uint16_t, uint16_t, double> running;
+	millis = 0;
+	for (int i = 0; i < 100000; i++){
+		running.push(i % 100, millis);
+		millis += 5;
+	}
+	CHECK(near(running.averageInterval(), 5));
+	CHECK(near(running.averageRateOfChange(), 0.2));
+	running.clear();
+	running.push(1, millis);
+	running.push(2, millis);
+	CHECK(running.averageRateOfChange() == 0); //no time between pushes
+}
+
+//sketch merged with itself counts each value twice; serialized sketch whose weights do not sum up to count is refused
+static void checkSketchSelfMerge(){
+	qsketchmedianbuffer<uint16_t, uint32_t, double> sketch(50), twice(50);
+	for (uint32_t i = 0; i < 10000; i++){
+		sketch.push((uint16_t)(i % 1000), i);
+		twice.push((uint16_t)(i % 1000), i);
+		twice.push((uint16_t)(i % 1000), i);
+	}
+	sketch.merge(sketch);
+	CHECK(sketch.getCount() == 20000);
+	CHECK(near(sketch.average(), twice.average()));
+	CHECK(sketch.median() >= 450 && sketch.median() <= 550);
+	CHECK(sketch.quantile(0.9) >= 850 && sketch.quantile(0.9) <= 950);
+
+	uint8_t bytes[4096];
+	unsigned long len = sketch.serialize(bytes);
+	qsketchmedianbuffer<uint16_t, uint32_t, double> copy(50);
+	CHECK(copy.deserialize(bytes, len));
+	CHECK(copy.median() == sketch.median());
+	unsigned long count = sketch.getCount() + 1;
+	memcpy(bytes + 2 + sizeof(uint16_t), &count, sizeof(count));
+	CHECK(!copy.deserialize(bytes, len));
+}
+
+//shards pushed with one clock that wraps many times are merged in order of pushes
+static void checkShardsAcrossWrap(){
+	qshardedmedianbuffer<uint16_t, uint8_t, double> sharded(10, 3);
+	uint8_t now = 200;
+	for (int i = 0; i < 100; i++){
+		sharded.push((uint16_t)(i % 7 % 3), (uint16_t)i, now); //shards get uneven share of pushes
+		now += 7;
+		if (i % 10 != 9) continue;
+		qmedianbuffer<uint16_t, uint8_t, double> &window = sharded.window();
+		CHECK(window.getCount() == 10);
+		for (int j = 0; j < 10; j++){
+			CHECK(window.pop() == i - 9 + j);
+		}
+	}
+	CHECK(near(sharded.window().averageInterval(), 7));
+}
+
+//entries pushed at the same time have interval 0, so rates are 0, not 1/0
+static void checkZeroInterval(){
+	qmedianbuffer<uint16_t, uint32_t, double> buf(8);
+	qmedianbuffer<uint16_t, uint32_t, double, qsortedindex> tracked(8, QMEDIANBUFFER_TRACK_INTERVALS);
+	for (int i = 0; i < 5; i++){
+		buf.push(i, 1000);
+		tracked.push(i, 1000);
+	}
+	CHECK(buf.averageRateOfChange() == 0);
+	CHECK(buf.medianRateOfChange() == 0);
+	CHECK(buf.medianAverageRateOfChange(1) == 0);
+	CHECK(tracked.averageRateOfChange() == 0);
+	CHECK(tracked.medianRateOfChange() == 0);
+	CHECK(tracked.medianAverageRateOfChange(1) == 0);
+}
+
+//vector compare-exchange keeps both values of each lane with NaN in it, as plain loop does
+static void checkLaneExchangeWithNaN(){
+	float a[8] = { 1, NAN, 3, NAN, 5, 6, NAN, 8 };
+	float b[8] = { 2, 0, NAN, NAN, 4, 6, 7, 1 };
+	float loopA[8], loopB[8];
+	std::copy(a, a + 8, loopA);
+	std::copy(b, b + 8, loopB);
+	qlaneexchange<float>::exchange(a, b, 8);
+	qlaneexchangeLoop<float>::exchange(loopA, loopB, 8);
+	for (int i = 0; i < 8; i++){
+		CHECK(a[i] == loopA[i] || (std::isnan(a[i]) && std::isnan(loopA[i])));
+		CHECK(b[i] == loopB[i] || (std::isnan(b[i]) && std::isnan(loopB[i])));
+	}
+}
+
+//pushMany() against the same entries pushed one by one, for random batches, with each companion in use
+template<template<typename, typename> class indexT>
+static void checkPushManyAgainstPush(uint8_t options){
+	srand(7);
+	for (int round = 0; round < 200; round++){
+		uint16_t capacity = 1 + rand() % 40;
+		qmedianbuffer<int16_t, uint16_t, double, indexT, uint16_t> batched(capacity, options);
+		qmedianbuffer<int16_t, uint16_t, double, indexT, uint16_t> single(capacity, options);
+		uint16_t now = (uint16_t)rand();
+
+		for (int step = 0; step < 30; step++){
+			int16_t numbers[100];
+			uint16_t timestamps[100];
+			unsigned long n = rand() % (step % 5 == 0 ? 100 : 12);
+			for (unsigned long i = 0; i < n; i++){
+				numbers[i] = (int16_t)(rand() % 200 - 100);
+				now += 1 + rand() % 3000;
+				timestamps[i] = now;
+			}
+			bool periodic = rand() % 2 == 0;
+			uint16_t period = (uint16_t)(1 + rand() % 3000);
+			if (periodic){
+				batched.pushMany(numbers, n, (uint16_t)(now + period), period);
+				for (unsigned long i = 0; i < n; i++) single.push(numbers[i], (uint16_t)(now + (i + 1) * period));
+				now += (uint16_t)(n * period);
+			}
+			else{
+				batched.pushMany(numbers, timestamps, n);
+				for (unsigned long i = 0; i < n; i++) single.push(numbers[i], timestamps[i]);
+			}
+			if (rand() % 4 == 0 && !single.isEmpty()){
+				CHECK(batched.pop() == single.pop());
+			}
+
+			CHECK(batched.getCount() == single.getCount());
+			CHECK(batched.isFull() == single.isFull());
+			CHECK(batched.getPushCount() == single.getPushCount());
+			if (single.isEmpty()) continue;
+			CHECK(batched.peek() == single.peek());
+			CHECK(batched.peekTime() == single.peekTime());
+			CHECK(batched.median() == single.median());
+			CHECK(near(batched.medianAverage(), single.medianAverage()));
+			CHECK(near(batched.average(), single.average()));
+			CHECK(batched.minValue() == single.minValue());
+			CHECK(batched.maxValue() == single.maxValue());
+			CHECK(near(batched.averageInterval(), single.averageInterval()));
+			CHECK(near(batched.medianInterval(), single.medianInterval()));
+		}
+	}
+}
+
+//median() and medianAverage(d) against sorted copy of entries in window, for random pushes and pops
+template<template<typename, typename> class indexT>
+static void checkMedianAgainstSorted(){
+	srand(11);
+	for (int round = 0; round < 200; round++){
+		uint16_t capacity = 1 + rand() % 60;
+		qmedianbuffer<int16_t, uint16_t, double, indexT, uint16_t> buf(capacity);
+		int16_t window[60];	//entries in buffer, oldest first
+		int count = 0;
+		int16_t range = (int16_t)(rand() % 2 == 0 ? 10 : 30000); //narrow range has many equal values
+
+		for (int step = 0; step < 100; step++){
+			if (rand() % 5 == 0 && count > 0){
+				buf.pop();
+				std::copy(window + 1, window + count, window);
+				count--;
+			}
+			else{
+				int16_t number = (int16_t)(rand() % (2 * range) - range);
+				buf.push(number, (uint16_t)step);
+				if (count == capacity){
+					std::copy(window + 1, window + count, window);
+					count--;
+				}
+				window[count++] = number;
+			}
+			if (count == 0) continue;
+
+			int16_t sorted[60];
+			std::copy(window, window + count, sorted);
+			std::sort(sorted, sorted + count);
+			CHECK(buf.median() == sorted[count / 2]);
+
+			int distance = rand() % (count + 1);
+			int even = count % 2 == 0 ? 1 : 0;
+			int d = std::min(distance, count / 2 - even);
+			double sum = 0;
+			for (int i = count / 2 - d - even; i <= count / 2 + d; i++) sum += sorted[i];
+			CHECK(near(buf.medianAverage((uint16_t)distance), sum / (1 + 2 * d + even)));
+		}
+	}
+}
+
+//queries of big fixed capacity buffer take scratch on heap, not on stack (16 MB here)
+static qmedianbuffer<double, uint32_t, double, qnoindex, uint32_t, 2000000> bigFixed;
+
+static void checkBigFixedCapacity(){
+	for (uint32_t i = 0; i < 2000000; i++) bigFixed.push(i % 1001, i);
+	CHECK(bigFixed.median() == 500);
+	CHECK(near(bigFixed.stats().median, 500));
+}
+
+int main(){
+	checkWrappingTime();
+	checkZeroInterval();
+	checkSketchSelfMerge();
+	checkShardsAcrossWrap();
+	checkLaneExchangeWithNaN();
+	checkBigFixedCapacity();
+	checkPushManyAgainstPush<qnoindex>(0);
+	checkPushManyAgainstPush<qsortedindex>(QMEDIANBUFFER_TRACK_MINMAX | QMEDIANBUFFER_TRACK_INTERVALS);
+	checkPushManyAgainstPush<qheapindex>(QMEDIANBUFFER_TRACK_MINMAX);
+	checkPushManyAgainstPush<qrankindex>(QMEDIANBUFFER_TRACK_INTERVALS);
+	checkPushManyAgainstPush<qhistindex>(QMEDIANBUFFER_TRACK_MINMAX);
+	checkMedianAgainstSorted<qnoindex>();
+	checkMedianAgainstSorted<qsortedindex>();
+	checkMedianAgainstSorted<qheapindex>();
+	checkMedianAgainstSorted<qrankindex>();
+	checkMedianAgainstSorted<qhistindex>();
+	printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+	return failures;
+}
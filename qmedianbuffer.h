@@ -4,8 +4,7 @@
    Buffer functions returns:
    -median() median value (the same, original value as in buffer)
    -medianAverage() median value, but average of surrounding entries
-   -average() average value, with slight error to avoid big number problem;
-   test and choose <double> if it is important to you
+   -average() average value, read from sum kept on each push and pop (exact, no overflow)
    -rateOfChange() 1/averageInterval (used for example for interrupts/sec cases)
 
    Usecase:
@@ -15,7 +14,7 @@
 
    NOTE important:
    type of <resultT> must be big enough to hold SUM of entire array if any function that averages
-   values is used. To handle this, just set <resultT> big enough.
+   values is used (except average(), that keeps its own wide sum, see qrunningsum). To handle this, just set <resultT> big enough.
    However, humans tend to forget this, but even so, unexpected values could appear unnoticed
    because of overflow. So, approach here is the oposite: approximation on averaging is used,
    with introduction of small error every time, but less fail when bigger numbers appear.
@@ -23,25 +22,23 @@
    and set <resultingT> to <double> (preffered), or if you use integer, double its size, that is
    use <long> instead of <int>.
 
-   NOTE also:
-   calculating anything needing interval, will delete all original numeric values
-
    Implementation:
    Optimised to be used in cases when there is a constant stream of data,
    but read is less often needed. Therefore, buffer would always be full and ready.
 
    Other designs of queue include one with +1 item in queue, or keeping track of lenght,
    using various pointer designs, or sometimes creating copy of array during sorting.
-   The one here tries to be simple and conserve memory. For this reason, each sort
-   reshuffes original, and each interval calc replaces numbers with intervals.
-
-   The problem of adding to circular buffer is that if sorting is done after each add
-   and if buffer was full, and then sorted, old and new items are no longer in sequence.
-   This matters only when items are added (this array is optimised for fast adding),
-   because age of entry is important for circular approach. Also, no holes should exist,
-   so the same should be done before pop.
-   It is here done by using struct as array items, with insertOrder info, values of
-   wich are valid just before sorting.
+   The one here never changes buffer on query: statistics that need values in order
+   (median, intervals) copy values to scratch array of that query and select in the copy.
+   Scratch is on stack up to QMEDIANBUFFER_STACK_SCRATCH entries (also with <fixedCapacity>), on heap above that;
+   so all queries are const, and many threads may read the same buffer at once (with no push meanwhile).
+
+   The problem of sorting circular buffer in place is that if buffer was full, and then sorted,
+   old and new items are no longer in sequence, and age of entry is important for circular approach.
+   With the scratch copy, items always stay in insert sequence, and are never changed,
+   so value and interval statistics can be mixed on the same buffer.
+   When median is read often, optional order index (<indexT>, see qsortedindex) can be set,
+   that keeps values in sorted order during push and pop, so median functions skip selecting.
 
    Note on values:
    -<T> type of numeric value used - integer, or double or whatever
@@ -50,10 +47,16 @@
    -<resultingT> type used for math operations; the idea is that you can have
    any numeric type in buffer, like <uint16_t>, but had result as double (say, 32bits)
 
-   -each data entry is the size of (<T> + <timeT> + 1 byte)
+   -each data entry is the size of (<T> + <timeT>);
+   values and times are kept in separate arrays, so there is no padding between them,
+   and scans over values (min, max, copy to scratch) read only values
+   -with QMEDIANBUFFER_TRACK_INTERVALS option, one more <timeT> per entry keeps interval to previous one
 
-   -max count: 255
-   -take care, any average() operation is with slight error due to approximations
+   -<sizeT> type of capacity, count and positions; default <uint8_t> keeps it small for
+   Arduino like systems, <uint16_t>, <uint32_t> for bigger windows
+
+   -max count: 255 for default <uint8_t> <sizeT> (max value of <sizeT>)
+   -take care, averaging operations (other then average()) are with slight error due to approximations
    -it is a smart thing to clear buffer after each statistical function,
    to remove old values, so that way you always have a fresh set of data,
    or you should take care of time added, and use delete function
@@ -77,6 +80,16 @@
 //you should leave this turned on (1) unless you are disciplined enough to know what you're doing
 #define RESTRICT_TYPES_OF_DATA 1
 
+//vector (SSE2/AVX2) min/max scans on x86; turn off (0) to use plain loops everywhere
+#define USE_SIMD_KERNELS 1
+
+//queries copy up to this many values to stack, more of them go to heap (with <fixedCapacity> too, so big windows never fill stack)
+#define QMEDIANBUFFER_STACK_SCRATCH 32
+
+//threaded headers pad data written by different threads this many bytes apart (cache line), so they do not share a line;
+//padding, not alignas, so it holds for objects allocated with new before C++17 too
+#define QMEDIANBUFFER_CACHE_LINE 64
+
 //-----------------------------------------------------------------------------------------------
 
 
@@ -87,6 +100,21 @@
 #define absX(value) abs(value) //standard abs has compile error if <resultingT> is unsigned long/int
 #endif
 
+//SSE2 is always there on x86-64; AVX2 only when compiler is told so (-mavx2, /arch:AVX2)
+#if USE_SIMD_KERNELS && !defined(ARDUINO) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define QMEDIANBUFFER_SSE2 1
+#if defined(__AVX2__)
+#define QMEDIANBUFFER_AVX2 1
+#include <immintrin.h>
+#else
+#define QMEDIANBUFFER_AVX2 0
+#include <emmintrin.h>
+#endif
+#else
+#define QMEDIANBUFFER_SSE2 0
+#define QMEDIANBUFFER_AVX2 0
+#endif
+
 //tests about types; if STD library is available, this may be removed, and std used
 #define is_type_signed(my_type) (((my_type)-1) < 0)
 #define is_type_unsigned(my_type) (((my_type)-1) > 0)
@@ -99,171 +127,1566 @@ and the result would be the same as if there was no casting at all
 */
 
 
+//--------------------------------order indexes-------------------------------------------------
+/*
+order index is optional companion of the buffer (passed as <indexT>), that follows each push and pop
+and keeps values in sorted order, so median functions can read n-th smallest value directly,
+without sorting the buffer back and forth.
+Each index gets ring position of item together with its value, and must answer by rank.
+
+-qnoindex: no index, each median function selects values in buffer (no extra memory at all)
+-qsortedindex: sorted copy of values; push/pop is O(n) shift, median is O(1), medianAverage O(distance);
+extra memory is (<T> * capacity)
+-qheapindex: two heaps with lazy deletion; push/pop is O(log n), median and medianAverage(0) O(1),
+wider medianAverage falls back to selecting; extra memory is about (2 * (<T> + 2 bytes) + 2) * capacity
+-qrankindex: balanced tree with subtree sizes (treap); push/pop and any rank is O(log n),
+extra memory is about (<T> + 5 bytes) * capacity
+-qhistindex: count of each value in two levels of bins, only for 8 and 16 bit integers;
+push/pop is O(1), any rank O(sqrt(range)), no sorting at all; extra memory is fixed by range of <T>,
+(<sizeT> * 272) for 8 bit and (<sizeT> * 65792) for 16 bit <T> (so not for small Arduino boards),
+plus <T> * capacity; other <T> fall back to qsortedindex
+*/
+
+//no index; median functions will select values in the buffer itself
+template<typename T, typename sizeT>
+class qnoindex
+{
+public:
+	void begin(sizeT) {}
+	void add(sizeT, T) {}
+	void remove(sizeT, T) {}
+	void clear() {}
+
+	bool hasRanks(sizeT, sizeT) const { return false; }
+	T at(sizeT) const { return T(); }
+};
+
+//sorted copy of values, each add/remove shifts the rest by one place
+template<typename T, typename sizeT>
+class qsortedindex
+{
+public:
+	~qsortedindex() {
+		delete[] _sorted;
+	}
+
+	void begin(sizeT capacity);
+	void add(sizeT pos, T value);
+	void remove(sizeT pos, T value);
+	void clear();
+
+	bool hasRanks(sizeT first, sizeT count) const;
+	T at(sizeT rank) const;
+
+private:
+	T *_sorted = nullptr;
+	sizeT _count{};
+
+	sizeT lowerBound(T value);
+};
+
+template<typename T, typename sizeT>
+void qsortedindex<T, sizeT>::begin(sizeT capacity) {
+	delete[] _sorted;
+	_sorted = new T[capacity];
+	_count = 0;
+}
+
+template<typename T, typename sizeT>
+void qsortedindex<T, sizeT>::add(sizeT, T value) {
+	sizeT i = lowerBound(value);
+	for (sizeT j = _count; j > i; j--){
+		_sorted[j] = _sorted[j - 1];
+	}
+	_sorted[i] = value;
+	_count++;
+}
+
+//any equal value will do, position is not important here
+template<typename T, typename sizeT>
+void qsortedindex<T, sizeT>::remove(sizeT, T value) {
+	sizeT i = lowerBound(value);
+	if (i == _count || _sorted[i] != value) return; //was never added
+	_count--;
+	for (; i < _count; i++){
+		_sorted[i] = _sorted[i + 1];
+	}
+}
+
+template<typename T, typename sizeT>
+void qsortedindex<T, sizeT>::clear() {
+	_count = 0;
+}
+
+template<typename T, typename sizeT>
+bool qsortedindex<T, sizeT>::hasRanks(sizeT first, sizeT count) const {
+	return (first + count) <= _count;
+}
+
+template<typename T, typename sizeT>
+T qsortedindex<T, sizeT>::at(sizeT rank) const {
+	return _sorted[rank];
+}
+
+//binary search for first place where value is not smaller then searched one
+template<typename T, typename sizeT>
+sizeT qsortedindex<T, sizeT>::lowerBound(T value) {
+	sizeT low = 0;
+	sizeT high = _count;
+	while (low < high){
+		sizeT mid = low + (high - low) / 2;
+		if (_sorted[mid] < value){
+			low = mid + 1;
+		}
+		else{
+			high = mid;
+		}
+	}
+	return low;
+}
+
+
+//two heaps around median: max-heap with lower half, min-heap with upper half of values
+//removed items are not searched for, they are only marked dead and dropped when they come to the top
+template<typename T, typename sizeT>
+class qheapindex
+{
+public:
+	~qheapindex() {
+		delete[] _gen;
+		delete[] _side;
+		delete[] _low.items;
+		delete[] _high.items;
+	}
+
+	void begin(sizeT capacity);
+	void add(sizeT pos, T value);
+	void remove(sizeT pos, T value);
+	void clear();
+
+	bool hasRanks(sizeT first, sizeT count) const;
+	T at(sizeT rank) const;
+
+private:
+	//heap entry is valid only while its ring position still holds it (same side, same generation)
+	struct entry {
+		T value;
+		sizeT pos;
+		uint8_t gen;
+	};
+	enum { SIDE_NONE = 0, SIDE_LOW = 1, SIDE_HIGH = 2 };
+
+	struct heap {
+		entry *items = nullptr;
+		sizeT size{};		//entries in array, dead included
+		sizeT live{};		//entries still in buffer
+		uint8_t side{};
+	};
+
+	heap _low;		//max on top, ranks 0 .. count/2 - 1
+	heap _high;		//min on top, ranks count/2 .. count - 1
+	uint8_t *_gen = nullptr;	//generation of each ring position, incremented on each add
+	uint8_t *_side = nullptr;	//which heap holds live entry of each ring position
+	sizeT _capacity{};
+
+	bool isLive(const entry &e, uint8_t side);
+	static bool isAbove(const heap &h, const entry &a, const entry &b);
+	void pushEntry(heap &h, entry e);
+	entry popTop(heap &h);
+	void siftDown(heap &h, sizeT i);
+	void dropDeadTop(heap &h);
+	void compact(heap &h);
+	void rebalance();
+};
+
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::begin(sizeT capacity) {
+	delete[] _gen;
+	delete[] _side;
+	delete[] _low.items;
+	delete[] _high.items;
+	_capacity = capacity;
+	_gen = new uint8_t[capacity]();
+	_side = new uint8_t[capacity]();
+	_low.items = new entry[capacity];
+	_low.side = SIDE_LOW;
+	_high.items = new entry[capacity];
+	_high.side = SIDE_HIGH;
+	_low.size = _low.live = 0;
+	_high.size = _high.live = 0;
+}
+
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::add(sizeT pos, T value) {
+	_gen[pos]++;
+	if (_gen[pos] == 0){
+		//generation wrapped, and some old dead entry could look alive again, so clean all now
+		compact(_low);
+		compact(_high);
+	}
+
+	entry e;
+	e.value = value;
+	e.pos = pos;
+	e.gen = _gen[pos];
+
+	if (_low.live > 0 && !(_low.items[0].value < value)){
+		pushEntry(_low, e);
+	}
+	else{
+		pushEntry(_high, e);
+	}
+	rebalance();
+}
+
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::remove(sizeT pos, T) {
+	if (_side[pos] == SIDE_LOW){
+		_low.live--;
+	}
+	else if (_side[pos] == SIDE_HIGH){
+		_high.live--;
+	}
+	else{
+		return; //was never added
+	}
+	_side[pos] = SIDE_NONE; //entry stays in heap, dead
+	dropDeadTop(_low);
+	dropDeadTop(_high);
+	rebalance();
+}
+
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::clear() {
+	_low.size = _low.live = 0;
+	_high.size = _high.live = 0;
+	for (sizeT i = 0; i < _capacity; i++){
+		_side[i] = SIDE_NONE;
+	}
+}
+
+//only two ranks around median are on top of heaps
+template<typename T, typename sizeT>
+bool qheapindex<T, sizeT>::hasRanks(sizeT first, sizeT count) const {
+	sizeT len = _low.live + _high.live;
+	if (count == 0 || first + count > len) return false;
+	return first + 1 >= len / 2 && first + count <= len / 2 + 1;
+}
+
+template<typename T, typename sizeT>
+T qheapindex<T, sizeT>::at(sizeT rank) const {
+	if (rank < _low.live){
+		return _low.items[0].value;
+	}
+	return _high.items[0].value;
+}
+
+template<typename T, typename sizeT>
+bool qheapindex<T, sizeT>::isLive(const entry &e, uint8_t side) {
+	return _side[e.pos] == side && _gen[e.pos] == e.gen;
+}
+
+//true if entry <a> belongs closer to the top of heap then <b>
+template<typename T, typename sizeT>
+bool qheapindex<T, sizeT>::isAbove(const heap &h, const entry &a, const entry &b) {
+	if (h.side == SIDE_LOW){
+		return b.value < a.value;
+	}
+	return a.value < b.value;
+}
+
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::pushEntry(heap &h, entry e) {
+	if (h.size == _capacity){
+		compact(h); //there is always at least one dead entry at this point
+	}
+	_side[e.pos] = h.side;
+	h.live++;
+
+	sizeT i = h.size++;
+	while (i > 0){
+		sizeT parent = (i - 1) / 2;
+		if (!isAbove(h, e, h.items[parent])) break;
+		h.items[i] = h.items[parent];
+		i = parent;
+	}
+	h.items[i] = e;
+}
+
+template<typename T, typename sizeT>
+typename qheapindex<T, sizeT>::entry qheapindex<T, sizeT>::popTop(heap &h) {
+	entry top = h.items[0];
+	h.live--;
+	h.items[0] = h.items[--h.size];
+	siftDown(h, 0);
+	dropDeadTop(h);
+	return top;
+}
+
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::siftDown(heap &h, sizeT i) {
+	entry e = h.items[i];
+	while (true){
+		sizeT child = 2 * i + 1;
+		if (child >= h.size || child < i) break;
+		if (child + 1 < h.size && isAbove(h, h.items[child + 1], h.items[child])) child++;
+		if (!isAbove(h, h.items[child], e)) break;
+		h.items[i] = h.items[child];
+		i = child;
+	}
+	h.items[i] = e;
+}
+
+//lazy deletion - dead entries are removed only when on top
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::dropDeadTop(heap &h) {
+	while (h.size > 0 && !isLive(h.items[0], h.side)){
+		h.items[0] = h.items[--h.size];
+		siftDown(h, 0);
+	}
+}
+
+//remove all dead entries and rebuild heap, O(n)
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::compact(heap &h) {
+	sizeT kept = 0;
+	for (sizeT i = 0; i < h.size; i++){
+		if (isLive(h.items[i], h.side)) h.items[kept++] = h.items[i];
+	}
+	h.size = kept;
+	for (sizeT i = h.size / 2; i > 0; i--){
+		siftDown(h, i - 1);
+	}
+}
+
+//lower heap holds exactly count/2 values, so top of upper heap is always median
+template<typename T, typename sizeT>
+void qheapindex<T, sizeT>::rebalance() {
+	sizeT half = (_low.live + _high.live) / 2;
+	while (_low.live > half){
+		pushEntry(_high, popTop(_low));
+	}
+	while (_low.live < half){
+		pushEntry(_low, popTop(_high));
+	}
+}
+
+
+//balanced search tree (treap) with size of each subtree, so n-th value is found walking from root
+//tree nodes are ring positions themselves, so no allocation is done after begin()
+template<typename T, typename sizeT>
+class qrankindex
+{
+public:
+	~qrankindex() {
+		delete[] _nodes;
+	}
+
+	void begin(sizeT capacity);
+	void add(sizeT pos, T value);
+	void remove(sizeT pos, T value);
+	void clear();
+
+	bool hasRanks(sizeT first, sizeT count) const;
+	T at(sizeT rank) const;
+
+private:
+	struct node {
+		T value;
+		sizeT left;
+		sizeT right;
+		sizeT size;		//count of nodes in subtree, this one included
+		uint16_t priority;	//random, parent is never lower then child
+	};
+
+	node *_nodes = nullptr;
+	sizeT _nil{};		//no node; equals capacity
+	sizeT _root{};
+	uint16_t _random = 0xACE1;
+
+	bool isBefore(sizeT a, sizeT b);	//order by value, equal values by position
+	sizeT sizeOf(sizeT n) const;
+	void update(sizeT n);
+	void split(sizeT n, sizeT key, sizeT &left, sizeT &right);
+	sizeT merge(sizeT left, sizeT right);
+	sizeT erase(sizeT n, sizeT key);
+};
+
+template<typename T, typename sizeT>
+void qrankindex<T, sizeT>::begin(sizeT capacity) {
+	delete[] _nodes;
+	_nodes = new node[capacity];
+	_nil = capacity;
+	_root = _nil;
+}
+
+template<typename T, typename sizeT>
+void qrankindex<T, sizeT>::add(sizeT pos, T value) {
+	//xorshift, good enough for balancing
+	_random ^= _random << 7;
+	_random ^= _random >> 9;
+	_random ^= _random << 8;
+
+	node &n = _nodes[pos];
+	n.value = value;
+	n.left = _nil;
+	n.right = _nil;
+	n.size = 1;
+	n.priority = _random;
+
+	sizeT left, right;
+	split(_root, pos, left, right);
+	_root = merge(merge(left, pos), right);
+}
+
+template<typename T, typename sizeT>
+void qrankindex<T, sizeT>::remove(sizeT pos, T) {
+	if (_root == _nil) return;
+	_root = erase(_root, pos);
+}
+
+template<typename T, typename sizeT>
+void qrankindex<T, sizeT>::clear() {
+	_root = _nil;
+}
+
+template<typename T, typename sizeT>
+bool qrankindex<T, sizeT>::hasRanks(sizeT first, sizeT count) const {
+	return (first + count) <= sizeOf(_root);
+}
+
+template<typename T, typename sizeT>
+T qrankindex<T, sizeT>::at(sizeT rank) const {
+	sizeT n = _root;
+	while (n != _nil){
+		sizeT leftSize = sizeOf(_nodes[n].left);
+		if (rank < leftSize){
+			n = _nodes[n].left;
+		}
+		else if (rank == leftSize){
+			return _nodes[n].value;
+		}
+		else{
+			rank -= leftSize + 1;
+			n = _nodes[n].right;
+		}
+	}
+	return T();
+}
+
+template<typename T, typename sizeT>
+bool qrankindex<T, sizeT>::isBefore(sizeT a, sizeT b) {
+	if (_nodes[a].value < _nodes[b].value) return true;
+	if (_nodes[b].value < _nodes[a].value) return false;
+	return a < b;
+}
+
+template<typename T, typename sizeT>
+sizeT qrankindex<T, sizeT>::sizeOf(sizeT n) const {
+	return n == _nil ? 0 : _nodes[n].size;
+}
+
+template<typename T, typename sizeT>
+void qrankindex<T, sizeT>::update(sizeT n) {
+	_nodes[n].size = 1 + sizeOf(_nodes[n].left) + sizeOf(_nodes[n].right);
+}
+
+//split subtree to nodes before <key> and the rest
+template<typename T, typename sizeT>
+void qrankindex<T, sizeT>::split(sizeT n, sizeT key, sizeT &left, sizeT &right) {
+	if (n == _nil){
+		left = right = _nil;
+		return;
+	}
+	if (isBefore(n, key)){
+		split(_nodes[n].right, key, _nodes[n].right, right);
+		left = n;
+	}
+	else{
+		split(_nodes[n].left, key, left, _nodes[n].left);
+		right = n;
+	}
+	update(n);
+}
+
+//join two subtrees, all nodes of <left> are before all nodes of <right>
+template<typename T, typename sizeT>
+sizeT qrankindex<T, sizeT>::merge(sizeT left, sizeT right) {
+	if (left == _nil) return right;
+	if (right == _nil) return left;
+	if (_nodes[left].priority > _nodes[right].priority){
+		_nodes[left].right = merge(_nodes[left].right, right);
+		update(left);
+		return left;
+	}
+	_nodes[right].left = merge(left, _nodes[right].left);
+	update(right);
+	return right;
+}
+
+template<typename T, typename sizeT>
+sizeT qrankindex<T, sizeT>::erase(sizeT n, sizeT key) {
+	if (n == _nil) return _nil; //was never added
+	if (n == key){
+		return merge(_nodes[n].left, _nodes[n].right);
+	}
+	if (isBefore(key, n)){
+		_nodes[n].left = erase(_nodes[n].left, key);
+	}
+	else{
+		_nodes[n].right = erase(_nodes[n].right, key);
+	}
+	update(n);
+	return n;
+}
+
+//counts of each value in two levels of bins (coarse bin is sum of its fine bins), so n-th value
+//is found walking coarse bins, and then fine bins of only one coarse bin; <keyBits> is width of <T>.
+//Value at each position is kept too, so clear empties only bins of held values
+template<typename T, typename sizeT, unsigned keyBits>
+class qbinnedindex
+{
+public:
+	~qbinnedindex() {
+		delete[] _fine;
+		delete[] _coarse;
+		delete[] _held;
+	}
+
+	void begin(sizeT capacity);
+	void add(sizeT pos, T value);
+	void remove(sizeT pos, T value);
+	void clear();
+
+	bool hasRanks(sizeT first, sizeT count) const;
+	T at(sizeT rank) const;
+
+private:
+	static const unsigned fineBits = keyBits / 2;
+	static const unsigned long keys = 1UL << keyBits;
+	static const unsigned long coarseBins = 1UL << (keyBits - fineBits);
+	//signed values are moved by sign bit, so bins are in the same order as values
+	static const unsigned long signBit = is_type_signed(T) ? 1UL << (keyBits - 1) : 0;
+
+	sizeT *_fine = nullptr;
+	sizeT *_coarse = nullptr;
+	T *_held = nullptr;	//value at each position of buffer
+	sizeT _capacity{};
+	sizeT _newest{};	//position added last; entries come and go in ring order, so held ones are <_count> positions back from it
+	sizeT _count{};
+
+	static unsigned long keyOf(T value) { return ((unsigned long)value ^ signBit) & (keys - 1); }
+	static T valueOf(unsigned long key) { return (T)(key ^ signBit); }
+};
+
+template<typename T, typename sizeT, unsigned keyBits>
+void qbinnedindex<T, sizeT, keyBits>::begin(sizeT capacity) {
+	delete[] _fine;
+	delete[] _coarse;
+	delete[] _held;
+	_fine = new sizeT[keys]();
+	_coarse = new sizeT[coarseBins]();
+	_held = new T[capacity];
+	_capacity = capacity;
+	_newest = 0;
+	_count = 0;
+}
+
+template<typename T, typename sizeT, unsigned keyBits>
+void qbinnedindex<T, sizeT, keyBits>::add(sizeT pos, T value) {
+	unsigned long key = keyOf(value);
+	_fine[key]++;
+	_coarse[key >> fineBits]++;
+	_held[pos] = value;
+	_newest = pos;
+	_count++;
+}
+
+template<typename T, typename sizeT, unsigned keyBits>
+void qbinnedindex<T, sizeT, keyBits>::remove(sizeT, T value) {
+	unsigned long key = keyOf(value);
+	if (_fine[key] == 0) return; //was never added
+	_fine[key]--;
+	_coarse[key >> fineBits]--;
+	_count--;
+}
+
+//O(count): only bins of held values are emptied, walking back from newest position
+template<typename T, typename sizeT, unsigned keyBits>
+void qbinnedindex<T, sizeT, keyBits>::clear() {
+	sizeT pos = _newest;
+	for (sizeT i = 0; i < _count; i++){
+		unsigned long key = keyOf(_held[pos]);
+		_fine[key]--;
+		_coarse[key >> fineBits]--;
+		pos = pos > 0 ? pos - 1 : _capacity - 1;
+	}
+	_count = 0;
+}
+
+template<typename T, typename sizeT, unsigned keyBits>
+bool qbinnedindex<T, sizeT, keyBits>::hasRanks(sizeT first, sizeT count) const {
+	return (first + count) <= _count;
+}
+
+//caller takes care rank is less then count
+template<typename T, typename sizeT, unsigned keyBits>
+T qbinnedindex<T, sizeT, keyBits>::at(sizeT rank) const {
+	unsigned long bin = 0;
+	while (rank >= _coarse[bin]){
+		rank -= _coarse[bin];
+		bin++;
+	}
+	unsigned long key = bin << fineBits;
+	while (rank >= _fine[key]){
+		rank -= _fine[key];
+		key++;
+	}
+	return valueOf(key);
+}
+
+//histogram of values for 8 and 16 bit integers (16 x 16 and 256 x 256 bins); push/pop is O(1),
+//each rank O(sqrt(range)), clear O(count); extra memory is (<sizeT> * (range + sqrt(range))), fixed, plus <T> * capacity.
+//Other types have too wide range for bins, so they fall back to qsortedindex
+template<typename T, typename sizeT>
+class qhistindex : public qsortedindex<T, sizeT> {};
+
+template<typename sizeT> class qhistindex<uint8_t, sizeT> : public qbinnedindex<uint8_t, sizeT, 8> {};
+template<typename sizeT> class qhistindex<int8_t, sizeT> : public qbinnedindex<int8_t, sizeT, 8> {};
+template<typename sizeT> class qhistindex<uint16_t, sizeT> : public qbinnedindex<uint16_t, sizeT, 16> {};
+template<typename sizeT> class qhistindex<int16_t, sizeT> : public qbinnedindex<int16_t, sizeT, 16> {};
+
+//-----------------------------------------------------------------------------------------------
+
+
+//--------------------------------span min/max kernels------------------------------------------
+/*
+fused min and max over one contiguous span of values (ring is scanned as two such spans);
+minV and maxV come in already set (e.g. to first value), and are only narrowed by the span.
+Generic version is plain loop; on x86 with SSE2 (or AVX2, when compiled with -mavx2)
+there are vector versions (qspanminmaxVector) for 8, 16 and 32 bit integers, <float> and <double>.
+Other types (64 bit integers, long double...) use the plain loop.
+*/
+
+template<typename T>
+struct qspanminmaxLoop
+{
+	static void scan(const T *arr, unsigned long len, T &minV, T &maxV) {
+		T lo = minV;
+		T hi = maxV;
+		for (unsigned long i = 0; i < len; i++){
+			T value = arr[i];
+			if (value < lo) lo = value;
+			if (value > hi) hi = value;
+		}
+		minV = lo;
+		maxV = hi;
+	}
+};
+
+template<typename T>
+struct qspanminmax : qspanminmaxLoop<T> {};
+
+#if QMEDIANBUFFER_SSE2
+
+/*
+vector operations for one type: V is vector type, load/splat/store move values in and out,
+vmin/vmax compare lanes. Where instruction set has no compare for the type, values are
+moved by bias to the type it has (e.g. unsigned 16 bit to signed 16 bit by flipping sign bit),
+kept biased in registers, and moved back on store.
+*/
+
+//and/andnot select: lanes where mask is set are taken from a, others from b
+static inline __m128i qsse2Select(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+#if QMEDIANBUFFER_AVX2
+
+struct qsimdU8 {
+	typedef __m256i V; typedef uint8_t T; static const unsigned lanes = 32;
+	static V load(const T *p) { return _mm256_loadu_si256((const V *)p); }
+	static V splat(T v) { return _mm256_set1_epi8((char)v); }
+	static void store(T *p, V v) { _mm256_storeu_si256((V *)p, v); }
+	static V vmin(V a, V b) { return _mm256_min_epu8(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_epu8(a, b); }
+};
+struct qsimdI8 {
+	typedef __m256i V; typedef int8_t T; static const unsigned lanes = 32;
+	static V load(const T *p) { return _mm256_loadu_si256((const V *)p); }
+	static V splat(T v) { return _mm256_set1_epi8(v); }
+	static void store(T *p, V v) { _mm256_storeu_si256((V *)p, v); }
+	static V vmin(V a, V b) { return _mm256_min_epi8(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_epi8(a, b); }
+};
+struct qsimdU16 {
+	typedef __m256i V; typedef uint16_t T; static const unsigned lanes = 16;
+	static V load(const T *p) { return _mm256_loadu_si256((const V *)p); }
+	static V splat(T v) { return _mm256_set1_epi16((short)v); }
+	static void store(T *p, V v) { _mm256_storeu_si256((V *)p, v); }
+	static V vmin(V a, V b) { return _mm256_min_epu16(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_epu16(a, b); }
+};
+struct qsimdI16 {
+	typedef __m256i V; typedef int16_t T; static const unsigned lanes = 16;
+	static V load(const T *p) { return _mm256_loadu_si256((const V *)p); }
+	static V splat(T v) { return _mm256_set1_epi16(v); }
+	static void store(T *p, V v) { _mm256_storeu_si256((V *)p, v); }
+	static V vmin(V a, V b) { return _mm256_min_epi16(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_epi16(a, b); }
+};
+struct qsimdU32 {
+	typedef __m256i V; typedef uint32_t T; static const unsigned lanes = 8;
+	static V load(const T *p) { return _mm256_loadu_si256((const V *)p); }
+	static V splat(T v) { return _mm256_set1_epi32((int)v); }
+	static void store(T *p, V v) { _mm256_storeu_si256((V *)p, v); }
+	static V vmin(V a, V b) { return _mm256_min_epu32(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_epu32(a, b); }
+};
+struct qsimdI32 {
+	typedef __m256i V; typedef int32_t T; static const unsigned lanes = 8;
+	static V load(const T *p) { return _mm256_loadu_si256((const V *)p); }
+	static V splat(T v) { return _mm256_set1_epi32(v); }
+	static void store(T *p, V v) { _mm256_storeu_si256((V *)p, v); }
+	static V vmin(V a, V b) { return _mm256_min_epi32(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_epi32(a, b); }
+};
+struct qsimdF32 {
+	typedef __m256 V; typedef float T; static const unsigned lanes = 8;
+	static V load(const T *p) { return _mm256_loadu_ps(p); }
+	static V splat(T v) { return _mm256_set1_ps(v); }
+	static void store(T *p, V v) { _mm256_storeu_ps(p, v); }
+	static V vmin(V a, V b) { return _mm256_min_ps(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_ps(a, b); }
+};
+struct qsimdF64 {
+	typedef __m256d V; typedef double T; static const unsigned lanes = 4;
+	static V load(const T *p) { return _mm256_loadu_pd(p); }
+	static V splat(T v) { return _mm256_set1_pd(v); }
+	static void store(T *p, V v) { _mm256_storeu_pd(p, v); }
+	static V vmin(V a, V b) { return _mm256_min_pd(a, b); }
+	static V vmax(V a, V b) { return _mm256_max_pd(a, b); }
+};
+
+#else //SSE2 only
+
+struct qsimdU8 {
+	typedef __m128i V; typedef uint8_t T; static const unsigned lanes = 16;
+	static V load(const T *p) { return _mm_loadu_si128((const V *)p); }
+	static V splat(T v) { return _mm_set1_epi8((char)v); }
+	static void store(T *p, V v) { _mm_storeu_si128((V *)p, v); }
+	static V vmin(V a, V b) { return _mm_min_epu8(a, b); }
+	static V vmax(V a, V b) { return _mm_max_epu8(a, b); }
+};
+//signed 8 bit biased to unsigned 8 bit
+struct qsimdI8 {
+	typedef __m128i V; typedef int8_t T; static const unsigned lanes = 16;
+	static V bias() { return _mm_set1_epi8((char)0x80); }
+	static V load(const T *p) { return _mm_xor_si128(_mm_loadu_si128((const V *)p), bias()); }
+	static V splat(T v) { return _mm_xor_si128(_mm_set1_epi8(v), bias()); }
+	static void store(T *p, V v) { _mm_storeu_si128((V *)p, _mm_xor_si128(v, bias())); }
+	static V vmin(V a, V b) { return _mm_min_epu8(a, b); }
+	static V vmax(V a, V b) { return _mm_max_epu8(a, b); }
+};
+//unsigned 16 bit biased to signed 16 bit
+struct qsimdU16 {
+	typedef __m128i V; typedef uint16_t T; static const unsigned lanes = 8;
+	static V bias() { return _mm_set1_epi16((short)0x8000); }
+	static V load(const T *p) { return _mm_xor_si128(_mm_loadu_si128((const V *)p), bias()); }
+	static V splat(T v) { return _mm_xor_si128(_mm_set1_epi16((short)v), bias()); }
+	static void store(T *p, V v) { _mm_storeu_si128((V *)p, _mm_xor_si128(v, bias())); }
+	static V vmin(V a, V b) { return _mm_min_epi16(a, b); }
+	static V vmax(V a, V b) { return _mm_max_epi16(a, b); }
+};
+struct qsimdI16 {
+	typedef __m128i V; typedef int16_t T; static const unsigned lanes = 8;
+	static V load(const T *p) { return _mm_loadu_si128((const V *)p); }
+	static V splat(T v) { return _mm_set1_epi16(v); }
+	static void store(T *p, V v) { _mm_storeu_si128((V *)p, v); }
+	static V vmin(V a, V b) { return _mm_min_epi16(a, b); }
+	static V vmax(V a, V b) { return _mm_max_epi16(a, b); }
+};
+//no 32 bit min/max in SSE2, so compare and select
+struct qsimdI32 {
+	typedef __m128i V; typedef int32_t T; static const unsigned lanes = 4;
+	static V load(const T *p) { return _mm_loadu_si128((const V *)p); }
+	static V splat(T v) { return _mm_set1_epi32(v); }
+	static void store(T *p, V v) { _mm_storeu_si128((V *)p, v); }
+	static V vmin(V a, V b) { return qsse2Select(_mm_cmpgt_epi32(a, b), b, a); }
+	static V vmax(V a, V b) { return qsse2Select(_mm_cmpgt_epi32(a, b), a, b); }
+};
+//unsigned 32 bit biased to signed 32 bit
+struct qsimdU32 {
+	typedef __m128i V; typedef uint32_t T; static const unsigned lanes = 4;
+	static V bias() { return _mm_set1_epi32((int)0x80000000u); }
+	static V load(const T *p) { return _mm_xor_si128(_mm_loadu_si128((const V *)p), bias()); }
+	static V splat(T v) { return _mm_xor_si128(_mm_set1_epi32((int)v), bias()); }
+	static void store(T *p, V v) { _mm_storeu_si128((V *)p, _mm_xor_si128(v, bias())); }
+	static V vmin(V a, V b) { return qsimdI32::vmin(a, b); }
+	static V vmax(V a, V b) { return qsimdI32::vmax(a, b); }
+};
+struct qsimdF32 {
+	typedef __m128 V; typedef float T; static const unsigned lanes = 4;
+	static V load(const T *p) { return _mm_loadu_ps(p); }
+	static V splat(T v) { return _mm_set1_ps(v); }
+	static void store(T *p, V v) { _mm_storeu_ps(p, v); }
+	static V vmin(V a, V b) { return _mm_min_ps(a, b); }
+	static V vmax(V a, V b) { return _mm_max_ps(a, b); }
+};
+struct qsimdF64 {
+	typedef __m128d V; typedef double T; static const unsigned lanes = 2;
+	static V load(const T *p) { return _mm_loadu_pd(p); }
+	static V splat(T v) { return _mm_set1_pd(v); }
+	static void store(T *p, V v) { _mm_storeu_pd(p, v); }
+	static V vmin(V a, V b) { return _mm_min_pd(a, b); }
+	static V vmax(V a, V b) { return _mm_max_pd(a, b); }
+};
+
+#endif //QMEDIANBUFFER_AVX2
+
+//whole vectors are compared lane by lane, lanes are reduced at the end, and the rest is plain loop
+template<typename ops>
+struct qspanminmaxVector
+{
+	typedef typename ops::T T;
+	typedef typename ops::V V;
+
+	static void scan(const T *arr, unsigned long len, T &minV, T &maxV) {
+		unsigned long i = 0;
+		if (len >= ops::lanes){
+			V lo = ops::splat(minV);
+			V hi = ops::splat(maxV);
+			for (; i + ops::lanes <= len; i += ops::lanes){
+				V v = ops::load(arr + i);
+				lo = ops::vmin(v, lo); //new value first: float min/max return second one for NaN, as plain loop skips it
+				hi = ops::vmax(v, hi);
+			}
+			T lanesLo[ops::lanes];
+			T lanesHi[ops::lanes];
+			ops::store(lanesLo, lo);
+			ops::store(lanesHi, hi);
+			qspanminmaxLoop<T>::scan(lanesLo, ops::lanes, minV, maxV);
+			qspanminmaxLoop<T>::scan(lanesHi, ops::lanes, minV, maxV);
+		}
+		qspanminmaxLoop<T>::scan(arr + i, len - i, minV, maxV);
+	}
+};
+
+template<> struct qspanminmax<uint8_t> : qspanminmaxVector<qsimdU8> {};
+template<> struct qspanminmax<int8_t> : qspanminmaxVector<qsimdI8> {};
+template<> struct qspanminmax<uint16_t> : qspanminmaxVector<qsimdU16> {};
+template<> struct qspanminmax<int16_t> : qspanminmaxVector<qsimdI16> {};
+template<> struct qspanminmax<uint32_t> : qspanminmaxVector<qsimdU32> {};
+template<> struct qspanminmax<int32_t> : qspanminmaxVector<qsimdI32> {};
+template<> struct qspanminmax<float> : qspanminmaxVector<qsimdF32> {};
+template<> struct qspanminmax<double> : qspanminmaxVector<qsimdF64> {};
+
+#endif //QMEDIANBUFFER_SSE2
+
+//-----------------------------------------------------------------------------------------------
+
+
+//--------------------------------sliding min/max-----------------------------------------------
+/*
+optional companion of the buffer (turned on with QMEDIANBUFFER_TRACK_MINMAX option), that follows
+each push and pop, so minValue(), maxValue() and range() are O(1) reads.
+Two monotonic queues of ring positions: each new value drops all values before it that can
+never again be min (or max), so front of queue is always min (max) of buffer;
+push is amortized O(1), extra memory is (2 * <sizeT> * capacity)
+*/
+
+template<typename T, typename sizeT>
+class qminmaxdeque
+{
+public:
+	~qminmaxdeque() {
+		delete[] _min.positions;
+		delete[] _max.positions;
+	}
+
+	void begin(sizeT capacity);
+	bool isActive() const { return _capacity > 0; }
+	void add(sizeT pos, T value, const T *values);
+	void remove(sizeT pos);
+	void clear();
+
+	//caller takes care buffer is not empty
+	sizeT minPos() const { return _min.positions[_min.first]; }
+	sizeT maxPos() const { return _max.positions[_max.first]; }
+
+private:
+	//ring of positions, values at them are rising (min queue) or falling (max queue) from first to last
+	struct queue {
+		sizeT *positions = nullptr;
+		sizeT first{};
+		sizeT count{};
+	};
+
+	queue _min;
+	queue _max;
+	sizeT _capacity{};
+
+	sizeT at(const queue &q, sizeT i) { return (sizeT)(q.first + i < _capacity ? q.first + i : q.first + i - _capacity); }
+	void pushBack(queue &q, sizeT pos);
+};
+
+template<typename T, typename sizeT>
+void qminmaxdeque<T, sizeT>::begin(sizeT capacity) {
+	delete[] _min.positions;
+	delete[] _max.positions;
+	_capacity = capacity;
+	_min.positions = new sizeT[capacity];
+	_max.positions = new sizeT[capacity];
+	clear();
+}
+
+//values is buffer array, so positions in queues can be compared without keeping values twice
+template<typename T, typename sizeT>
+void qminmaxdeque<T, sizeT>::add(sizeT pos, T value, const T *values) {
+	while (_min.count > 0 && value < values[_min.positions[at(_min, _min.count - 1)]]) _min.count--;
+	pushBack(_min, pos);
+	while (_max.count > 0 && value > values[_max.positions[at(_max, _max.count - 1)]]) _max.count--;
+	pushBack(_max, pos);
+}
+
+//only oldest entry is ever removed; it is at front of queue, if still there
+template<typename T, typename sizeT>
+void qminmaxdeque<T, sizeT>::remove(sizeT pos) {
+	if (_min.count > 0 && _min.positions[_min.first] == pos){
+		_min.first = at(_min, 1);
+		_min.count--;
+	}
+	if (_max.count > 0 && _max.positions[_max.first] == pos){
+		_max.first = at(_max, 1);
+		_max.count--;
+	}
+}
+
+template<typename T, typename sizeT>
+void qminmaxdeque<T, sizeT>::clear() {
+	_min.first = _min.count = 0;
+	_max.first = _max.count = 0;
+}
+
+template<typename T, typename sizeT>
+void qminmaxdeque<T, sizeT>::pushBack(queue &q, sizeT pos) {
+	q.positions[at(q, q.count)] = pos;
+	q.count++;
+}
+
+//-----------------------------------------------------------------------------------------------
+
+
+//--------------------------------running sum---------------------------------------------------
+/*
+sum of values in buffer, kept on each push and pop, so average() is O(1).
+Integers are summed exactly in accumulator wide enough for (<T> * max count of <sizeT>):
+32 bit for small types, 64 bit, or 128 bit where compiler has it (else 64 bit, and it may overflow
+only for 64 bit <T> with huge values). Floating types are summed in at least <double>, with
+compensation (Neumaier), so adding and removing the same values does not drift away.
+*/
+
+//wide integer of given size and sign
+template<bool isSigned, unsigned bytes> struct qwideint {};
+template<> struct qwideint<true, 4> { typedef int32_t type; };
+template<> struct qwideint<false, 4> { typedef uint32_t type; };
+template<> struct qwideint<true, 8> { typedef int64_t type; };
+template<> struct qwideint<false, 8> { typedef uint64_t type; };
+#if defined(__SIZEOF_INT128__)
+#define QMEDIANBUFFER_INT128 1
+template<> struct qwideint<true, 16> { __extension__ typedef __int128 type; };
+template<> struct qwideint<false, 16> { __extension__ typedef unsigned __int128 type; };
+#else
+#define QMEDIANBUFFER_INT128 0
+#endif
+
+//integer values: exact sum
+template<typename T, typename sizeT, bool isFloat = (((T)1) / 2 != 0)>
+struct qrunningsum
+{
+	static const unsigned bytesNeeded = sizeof(T) + sizeof(sizeT);
+	typedef typename qwideint<is_type_signed(T), (bytesNeeded < 4 ? 4 : (bytesNeeded <= 8 || !QMEDIANBUFFER_INT128) ? 8 : 16)>::type accT;
+
+	accT sum{};
+
+	void add(T value) { sum += (accT)value; }
+	void remove(T value) { sum -= (accT)value; }
+	void clear() { sum = 0; }
+	bool isValid() const { return true; }
+	bool needsRebuild() const { return false; }
+
+	//contiguous span at once, summed apart first (so the loop can be vectorized)
+	void addSpan(const T *arr, sizeT len) { sum += spanSum(arr, len); }
+	void removeSpan(const T *arr, sizeT len) { sum -= spanSum(arr, len); }
+
+	//sums of parts summed apart (e.g. by threads), and the same value many times
+	void merge(const qrunningsum &other) { sum += other.sum; }
+	void addRepeated(T value, sizeT times) { sum += (accT)value * (accT)times; }
+
+	//whole part is divided in accumulator, so only remainder is converted to <resultingT>
+	template<typename resultingT> resultingT average(sizeT count) const {
+		accT quotient = sum / (accT)count;
+		accT remainder = sum % (accT)count;
+		return (resultingT)quotient + (resultingT)remainder / (resultingT)count;
+	}
+
+private:
+	static accT spanSum(const T *arr, sizeT len) {
+		accT spanTotal = 0;
+		for (sizeT i = 0; i < len; i++) spanTotal += (accT)arr[i];
+		return spanTotal;
+	}
+};
+
+//floating values: compensated sum
+template<typename T, typename sizeT>
+struct qrunningsum<T, sizeT, true>
+{
+	typedef decltype(T() + 0.0) accT; //at least double
+
+	accT sum{};
+	accT compensation{};
+
+	void add(T value) { addTerm((accT)value); }
+	void remove(T value) { addTerm(-(accT)value); }
+	void addSpan(const T *arr, sizeT len) { for (sizeT i = 0; i < len; i++) addTerm((accT)arr[i]); }
+	void removeSpan(const T *arr, sizeT len) { for (sizeT i = 0; i < len; i++) addTerm(-(accT)arr[i]); }
+	void merge(const qrunningsum &other) {
+		addTerm(other.sum);
+		compensation += other.compensation;
+	}
+	void addRepeated(T value, sizeT times) { addTerm((accT)value * (accT)times); }
+	void clear() { sum = compensation = 0; }
+	//infinity in sum makes it invalid (average is then the sum itself); after infinity is removed,
+	//sum is NaN and is rebuilt from buffer (on each change, as long as NaN or both infinities are in it)
+	bool isValid() const { return (sum - sum) == 0; }
+	bool needsRebuild() const { return sum != sum; }
+
+	template<typename resultingT> resultingT average(sizeT count) const {
+		accT total = isValid() ? sum + compensation : sum; //compensation of infinity is NaN
+		return (resultingT)(total / (accT)count);
+	}
+
+private:
+	void addTerm(accT term) {
+		accT t = sum + term;
+		if (absX(sum) >= absX(term)){
+			compensation += (sum - t) + term;
+		}
+		else{
+			compensation += (term - t) + sum;
+		}
+		sum = t;
+	}
+};
+
+//sum of intervals between consecutive times, for averageInterval() and averageRateOfChange() of any buffer;
+//each interval is taken in <timeT> (later - earlier wraps back), so sum stays right when clock wraps,
+//where newest - oldest time would not; count of intervals is kept by owner (it is known there anyway)
+template<typename timeT, typename sizeT>
+struct qintervalsum
+{
+	qrunningsum<timeT, sizeT> sum;
+
+	static timeT between(timeT earlier, timeT later) { return (timeT)(later - earlier); }
+
+	void add(timeT interval) { sum.add(interval); }
+	void remove(timeT interval) { sum.remove(interval); }
+	void addBetween(timeT earlier, timeT later) { sum.add(between(earlier, later)); }
+	void removeBetween(timeT earlier, timeT later) { sum.remove(between(earlier, later)); }
+	void merge(const qintervalsum &other) { sum.merge(other.sum); }
+	void clear() { sum.clear(); }
+
+	//0 when there are no intervals
+	template<typename resultingT> resultingT average(sizeT count) const {
+		if (count == 0) return resultingT();
+		return sum.template average<resultingT>(count);
+	}
+	//1 / average interval; 0 when there are no intervals, or all of them are 0
+	template<typename resultingT> resultingT rate(sizeT count) const {
+		resultingT interval = average<resultingT>(count);
+		if (interval == 0) return resultingT();
+		return 1 / interval;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------
+
+
+//--------------------------------median band---------------------------------------------------
+
+//positions around median, at max distance from it; distance is corrected if it is too big
+//(free function, so buffers other then qmedianbuffer pick the same values)
+template<typename sizeT>
+void qmedianband(sizeT len, sizeT &maxDistanceFromMedian, sizeT &startpos, sizeT &total){
+
+	/*
+	median is in the middle of sorted array, if len is even, then median is middle of two middle numbers
+	that means that in case of len = 6, distance = 1, evaluated array items are => | 0, 1, (1, 1), 1, 0 |; total = 4
+	for even len, distance can be at most len/2 - 1, or start would be before the first item
+	*/
+	sizeT evenNumCorrection = 0;
+	if (len % 2 == 0) evenNumCorrection = 1;
+
+	if (maxDistanceFromMedian > len / 2 - evenNumCorrection) maxDistanceFromMedian = len / 2 - evenNumCorrection;
+	startpos = len / 2 - maxDistanceFromMedian - evenNumCorrection; //so middle is found, start earlier
+	total = 1 + 2 * maxDistanceFromMedian + evenNumCorrection; //so middle is found, it is one more
+}
+
+//-----------------------------------------------------------------------------------------------
+
+
+//--------------------------------ring memory---------------------------------------------------
+
+//array of ring items; inline when capacity is known at compile time (<N> > 0), otherwise allocated once
+template<typename itemT, unsigned long N>
+struct qringarray
+{
+	itemT items[N];
+
+	void allocate(unsigned long) {}
+	itemT *data() { return items; }
+	const itemT *data() const { return items; }
+	itemT &operator[](unsigned long pos) { return items[pos]; }
+	const itemT &operator[](unsigned long pos) const { return items[pos]; }
+};
+
+template<typename itemT>
+struct qringarray<itemT, 0>
+{
+	itemT *items = nullptr;
+
+	~qringarray() {
+		delete[] items;
+	}
+
+	void allocate(unsigned long capacity) { items = new itemT[capacity]; }
+	itemT *data() { return items; }
+	const itemT *data() const { return items; }
+	itemT &operator[](unsigned long pos) { return items[pos]; }
+	const itemT &operator[](unsigned long pos) const { return items[pos]; }
+};
+
+//working copy of values for one query, so buffer itself is never changed by reading it;
+//on stack up to <N> entries, on heap for more
+template<typename itemT, unsigned long N>
+struct qscratch
+{
+	itemT local[N];
+	itemT *items;
+
+	explicit qscratch(unsigned long len) : items(len > N ? new itemT[len] : local) {}
+	~qscratch() {
+		if (items != local) delete[] items;
+	}
+	qscratch(const qscratch &) = delete;
+	qscratch &operator=(const qscratch &) = delete;
+
+	itemT *data() { return items; }
+};
+
+
+//-----------------------------------------------------------------------------------------------
+
+
+//options of constructor, optional companions kept on each push and pop (bits can be or-ed)
+#define QMEDIANBUFFER_TRACK_MINMAX 0x01	//sliding min/max (qminmaxdeque), minValue(), maxValue(), range() in O(1)
+#define QMEDIANBUFFER_TRACK_INTERVALS 0x02	//interval ring, interval to previous entry kept on push (+<timeT> per entry)
+
 //<T> numeric data stored; <timeT> strictly UNSIGNED type for incremental time data, <resultingT> return type of math heavy functions
-template<typename T, typename timeT, typename resultingT>
+//<indexT> optional order index (see above), kept up to date on each push and pop
+//<sizeT> UNSIGNED type for capacity, positions and counters; max capacity is its max value
+//<fixedCapacity> if set, capacity is known at compile time, and buffer is kept inline (no heap);
+//power of two capacity is then best, since positions wrap by bit mask instead of division
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT = qnoindex, typename sizeT = uint8_t, sizeT fixedCapacity = 0>
 class qmedianbuffer
 {
 
 #if RESTRICT_TYPES_OF_DATA
 	static_assert(is_type_signed(resultingT), "qmedianbuffer: non-recommended type for <resultingT>; should be any signed type (<int>, <float>, <double>...)");
 	static_assert(is_type_unsigned(timeT), "qmedianbuffer: non-recommended type for <timeT>; should be any unsigned type (<uint16_t>, <uint32_t>...)");
+	static_assert(is_type_unsigned(sizeT), "qmedianbuffer: non-recommended type for <sizeT>; should be any unsigned type (<uint8_t>, <uint16_t>, <uint32_t>...)");
 #endif
 
 public:
 
-	//initiate circular buffer, capacity best to be uneven number
-	qmedianbuffer(uint8_t capacity) {
-		_capacity = capacity;
-		items = new itemQ[capacity];
+	//initiate circular buffer, capacity best to be uneven number; with <fixedCapacity> set, argument is ignored
+	//options are QMEDIANBUFFER_... bits above
+	//with <fixedCapacity>, <capacity> is ignored; without it, capacity 0 is taken as 1, as there would be no room for any entry
+	qmedianbuffer(sizeT capacity, uint8_t options = 0) {
+		_capacity = fixedCapacity ? fixedCapacity : capacity ? capacity : 1;
+		values.allocate(_capacity);
+		times.allocate(_capacity);
+		_index.begin(_capacity);
+		if (options & QMEDIANBUFFER_TRACK_MINMAX) _minMax.begin(_capacity);
+		if (options & QMEDIANBUFFER_TRACK_INTERVALS){
+			intervals.allocate(_capacity);
+			_intervalIndex.begin(_capacity);
+			_tracksIntervals = true;
+		}
 	}
-	~qmedianbuffer() {
-		delete[] items;
+	template<sizeT N = fixedCapacity>
+	qmedianbuffer() : qmedianbuffer(N) {
+		static_assert(N > 0, "qmedianbuffer: capacity must be given, unless <fixedCapacity> is set");
 	}
 
 	void push(T number, timeT currentTime);
+	void pushMany(const T *numbers, const timeT *timestamps, unsigned long n);
+	void pushMany(const T *numbers, unsigned long n, timeT firstTime, timeT period);
 	T pop();
-	T peek();
-	timeT peekTime();
+	T peek() const;
+	timeT peekTime() const;
 	void clear();
 
-	bool isFull();
-	bool isEmpty();
-	uint8_t getCount();
+	bool isFull() const;
+	bool isEmpty() const;
+	sizeT getCount() const;
+	sizeT getCapacity() const;
 
-	uint8_t getPushCount();
+	sizeT getPushCount() const;
 	void resetPushCount();
 
 	bool deleteOld(timeT currentTimeStamp, timeT interval);
 
-	T maxValue();
-	T minValue();
+	T maxValue() const;
+	T minValue() const;
+
+	T range() const;
+	sizeT occurenceOfValue(T testValue, T epsilon) const;
+	resultingT frequencyOfValue(T testValue, T epsilon) const;
 
-	T range();
-	uint8_t occurenceOfValue(T testValue, T epsilon);
-	resultingT frequencyOfValue(T testValue, T epsilon);
+	resultingT meanAbsoluteDeviationAroundAverage() const;
+	resultingT meanAbsoluteDeviationAroundMedianAverage(sizeT maxDistanceFromMedian) const;
 
-	resultingT meanAbsoluteDeviationAroundAverage();
-	resultingT meanAbsoluteDeviationAroundMedianAverage(uint8_t maxDistanceFromMedian);
+	resultingT average() const;
 
-	resultingT average();
+	T median() const;
+	resultingT medianAverage() const;
+	resultingT medianAverage(sizeT maxDistance) const;
 
-	T median();
-	resultingT medianAverage();
-	resultingT medianAverage(uint8_t maxDistance);
+	resultingT averageInterval() const;
+	resultingT averageRateOfChange() const;
 
-	resultingT averageInterval();
-	resultingT averageRateOfChange();
+	T medianInterval() const;
+	resultingT medianAverageInterval(sizeT maxDistanceFromMedian) const;
+	resultingT medianRateOfChange() const;										// 1/medianInterval
+	resultingT medianAverageRateOfChange(sizeT maxDistanceFromMedian) const;	// 1/medianAverageInterval
+
+	//value statistics read together, from one scan of buffer and at most one selection
+	struct statistics {
+		sizeT count;
+		T minValue;
+		T maxValue;
+		resultingT average;
+		T median;
+		resultingT medianAverage;
+		resultingT meanAbsoluteDeviationAroundAverage;
+	};
+	statistics stats() const;
+	statistics stats(sizeT maxDistanceFromMedian) const;
 
-	T medianInterval();
-	resultingT medianAverageInterval(uint8_t maxDistanceFromMedian);
-	resultingT medianRateOfChange();										// 1/medianInterval
-	resultingT medianAverageRateOfChange(uint8_t maxDistanceFromMedian);	// 1/medianAverageInterval
+	//values in insert order, as two contiguous parts of ring (second is empty when they do not wrap),
+	//for code that scans or splits them itself
+	void spans(const T *&first, sizeT &firstLen, const T *&second, sizeT &secondLen) const;
 
 	/*void debug(){
 		std::cout << "-----------" << std::endl;
-		for (uint8_t i = 0; i < getCount(); i++){
-			itemQ *item = getItemAtPositionPtr(i);
-			std::cout << "V: " << (int)item->value << "\t O: " << (int)item->insertOrder << "\t T: " << (int)item->time << std::endl;
+		for (sizeT i = 0; i < getCount(); i++){
+			sizeT pos = getTruePos(i, _tail, getCapacity());
+			std::cout << "V: " << (int)values[pos] << "\t T: " << (int)times[pos] << std::endl;
 		}
 	}*/
 
 private:
-	struct itemQ {
-		uint8_t insertOrder{};
-		T value{};
-		timeT time{};
+	static sizeT getTruePos(sizeT pos, sizeT tail, sizeT capacity);
+
+	//value at position, read in insert order from buffer itself
+	struct ringValues {
+		sizeT tail;
+		const T *arr;
+		sizeT arrCapacity;
+		T operator()(sizeT pos) const { return arr[getTruePos(pos, tail, arrCapacity)]; }
 	};
+	//value at position in scratch array; after select, n-th smallest value around median
+	struct scratchValues {
+		const T *arr;
+		T operator()(sizeT pos) const { return arr[pos]; }
+	};
+	//n-th smallest value, read from order index, no selecting needed
+	struct indexedValues {
+		const indexT<T, sizeT> *index;
+		T operator()(sizeT rank) const { return index->at(rank); }
+	};
+	//n-th smallest interval, read from interval order index, as <T> (as intervals in scratch)
+	struct indexedIntervals {
+		const indexT<timeT, sizeT> *index;
+		T operator()(sizeT rank) const { return (T)index->at(rank); }
+	};
+
+	static void medianBand(sizeT len, sizeT &maxDistanceFromMedian, sizeT &startpos, sizeT &total);
 
-	static uint8_t getTruePos(uint8_t pos, uint8_t len, uint8_t capacity);
+	template<typename rankedT> static T _median(sizeT len, const rankedT &ranked);
+	template<typename rankedT> static resultingT _medianAverage(sizeT len, sizeT maxDistanceFromMedian, const rankedT &ranked);
+	template<typename rankedT> static resultingT _meanAbsoluteDeviationAroundMedianAverage(sizeT len, sizeT maxDistanceFromMedian, const rankedT &ranked);
 
-	static T _median(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate));
-	static resultingT _medianAverage(uint8_t tail, uint8_t len, uint8_t maxDistanceFromMedian, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate));
-	static resultingT _meanAbsoluteDeviationAroundMedianAverage(uint8_t tail, uint8_t len, uint8_t maxDistanceFromMedian, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate));
+	template<typename valuesT> static resultingT _average(sizeT len, const valuesT &values);
+	template<typename valuesT> static resultingT _meanAbsoluteDeviationAroundAverage(sizeT len, resultingT avg, const valuesT &values);
 
-	static resultingT _average(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate));
-	static resultingT _meanAbsoluteDeviationAroundAverage(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate));
+	static void sort(T *arr, sizeT len);
+	static void select(T *arr, sizeT first, sizeT last, sizeT k);
+	static sizeT medianOfMedians(T *arr, sizeT first, sizeT last);
+	static void swapValues(T *arr, sizeT posA, sizeT posB);
 
-	static void sort(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate));
+	static const bool isPowerOfTwo = fixedCapacity > 0 && (fixedCapacity & (fixedCapacity - 1)) == 0;
 
-	itemQ* items;
-	uint8_t _capacity{};
-	uint8_t _head{};
-	uint8_t _tail{};
+	//values and times are kept apart, so scans over values read only values (and no padding)
+	qringarray<T, fixedCapacity> values;
+	qringarray<timeT, fixedCapacity> times;
+	qringarray<timeT, fixedCapacity> intervals;	//time from previous entry, at position of later one; only with QMEDIANBUFFER_TRACK_INTERVALS
+	bool _tracksIntervals{};
+	sizeT _capacity{};
+	sizeT _head{};
+	sizeT _tail{};
 	bool _isFull{};
 
-	uint8_t _pushCount{};
+	sizeT _pushCount{};
 
-	static T getItemValue(const itemQ &item);
-	static T getItemInsertOrder(const itemQ &item);
+	indexT<T, sizeT> _index;
+	indexT<timeT, sizeT> _intervalIndex;	//order of intervals, only with QMEDIANBUFFER_TRACK_INTERVALS
+	qrunningsum<T, sizeT> _sum;
+	qintervalsum<timeT, sizeT> _intervalSum;	//of intervals between entries, so span of window may wrap
+	qminmaxdeque<T, sizeT> _minMax;	//not active unless QMEDIANBUFFER_TRACK_MINMAX
 
-	bool valuesAreGoodIntervals = false;
+	void rebuildSum();
+	//working copy of values for one query (see qscratch); stack part is never bigger then QMEDIANBUFFER_STACK_SCRATCH
+	typedef qscratch<T, (fixedCapacity > 0 && fixedCapacity < QMEDIANBUFFER_STACK_SCRATCH) ? fixedCapacity : QMEDIANBUFFER_STACK_SCRATCH> scratchT;
+	sizeT valuesToScratch(T *scratch) const;
+	template<bool copyValues> void scanToScratch(const T *src, sizeT len, T *scratch, sizeT offset, statistics &st) const;
+	sizeT intervalsToScratch(T *scratch) const;
+	static void selectInScratch(T *scratch, sizeT len, sizeT maxDistanceFromMedian);
+
+	template<typename orderT> static bool indexHasBand(const orderT &index, sizeT len, sizeT maxDistanceFromMedian);
+
+	//time of n-th entry in batch, from array or by uniform period
+	struct arrayTimes {
+		const timeT *arr;
+		timeT operator()(unsigned long i) const { return arr[i]; }
+	};
+	struct periodicTimes {
+		timeT firstTime;
+		timeT period;
+		timeT operator()(unsigned long i) const { return (timeT)(firstTime + (timeT)i * period); }
+	};
 
-	void resetItemOrderOldestToZero();	//oldest item will have internal counter set to zero, others will increment
-	void sortToInsertSequence();
-	void sortToValues(uint8_t len);
-	void intervalsToValues();
+	template<typename timesT> void pushBatch(const T *numbers, unsigned long n, const timesT &timeAt);
+	void dropOldest(sizeT n);
+	void removeFromCompanions(sizeT start, sizeT len, bool hasFollower);
+	void addToCompanions(sizeT start, sizeT len, bool hasPrevious);
 
-	itemQ* peekItem();
-	itemQ* getItemAtPositionPtr(uint8_t position);
+	sizeT nextPos(sizeT pos) const;
+	sizeT prevPos(sizeT pos) const;
+	void getSpans(sizeT &firstLen, sizeT &secondLen) const;
+	void getSpans(sizeT start, sizeT len, sizeT &firstLen, sizeT &secondLen) const;
+	void minMax(T &minV, T &maxV) const;
 };
 
 //------------------pop push peek-----------------
 
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::push(T number, timeT currentTime) {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::push(T number, timeT currentTime) {
 	_pushCount++; //non important, user info counter of all push operations
 
-	itemQ newitem;
-	newitem.value = number;
-	valuesAreGoodIntervals = false;
-
-	newitem.time = currentTime;
-	//newitem.insertOrder is not important now; it is written pre shuffle, for reshuffling back
-
-	items[_head] = newitem;
+	//new entry has interval to newest one, if that one is not overwritten now (capacity of 1)
+	bool hasPrevious = !isEmpty() && getCapacity() > 1;
+	timeT interval = hasPrevious ? _intervalSum.between(times[prevPos(_head)], currentTime) : timeT();
+	if (hasPrevious && _tracksIntervals){
+		intervals[_head] = interval;
+	}
 	if (_isFull){
-		_tail = (_tail + 1) % _capacity;
+		//entry after oldest one becomes oldest, and has no interval any more
+		if (hasPrevious){
+			sizeT follower = nextPos(_head);
+			_intervalSum.removeBetween(times[_head], times[follower]);
+			if (_tracksIntervals) _intervalIndex.remove(follower, intervals[follower]);
+		}
+		_index.remove(_head, values[_head]); //oldest one is overwritten
+		_sum.remove(values[_head]);
+		if (_minMax.isActive()) _minMax.remove(_head);
+		_tail = nextPos(_tail);
+	}
+	values[_head] = number;
+	times[_head] = currentTime;
+	_index.add(_head, number);
+	_sum.add(number);
+	if (hasPrevious){
+		_intervalSum.add(interval);
+		if (_tracksIntervals) _intervalIndex.add(_head, interval);
 	}
-	_head = (_head + 1) % _capacity;
+	if (_minMax.isActive()) _minMax.add(_head, number, values.data());
+	_head = nextPos(_head);
 	_isFull = _head == _tail;
+	if (_sum.needsRebuild()) rebuildSum();
 }
 
 //pop will take the oldes one out by tracking insertion order (not time)
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::pop() {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::pop() {
 
 	if (isEmpty()) return T();
 
-	valuesAreGoodIntervals = false; //intervals are no longer valid
+	T value = values[_tail];
+	dropOldest(1);
+	return value;
+}
+
+//n oldest entries leave buffer and all companions, tail moves once; caller takes care there are n entries
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::dropOldest(sizeT n) {
+	sizeT count = getCount();
+	sizeT firstLen, secondLen;
+	getSpans(_tail, n, firstLen, secondLen);
+	removeFromCompanions(_tail, firstLen, firstLen < count);
+	removeFromCompanions(0, secondLen, n < count);
 
-	itemQ *item = getItemAtPositionPtr(0);
 	_isFull = false; //it will for sure not be full
-	_tail = (_tail + 1) % _capacity;
-	return item->value;
+	_tail = secondLen > 0 ? secondLen : _tail + firstLen;
+	if (_tail == getCapacity()) _tail = 0;
+	if (_head == _tail){
+		//empty now, so no rounding left behind
+		_sum.clear();
+		_intervalSum.clear();
+	}
+	if (_sum.needsRebuild()) rebuildSum();
 }
 
-//returns value of oldest item
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::peek() {
-	return peekItem()->value;
+//entries in contiguous span [start, start + len) leave companions; hasFollower if entry after span stays
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::removeFromCompanions(sizeT start, sizeT len, bool hasFollower) {
+	if (len == 0) return;
+	T *valueArr = values.data();
+	_sum.removeSpan(valueArr + start, len);
+	for (sizeT pos = start; pos < start + len; pos++){
+		_index.remove(pos, valueArr[pos]);
+	}
+	if (_minMax.isActive()){
+		for (sizeT pos = start; pos < start + len; pos++) _minMax.remove(pos);
+	}
+	//entry after each removed one loses its interval (after last removed one, only if it stays)
+	const timeT *timeArr = times.data();
+	for (sizeT pos = start + 1; pos < start + len; pos++){
+		_intervalSum.removeBetween(timeArr[pos - 1], timeArr[pos]);
+		if (_tracksIntervals) _intervalIndex.remove(pos, intervals[pos]);
+	}
+	if (hasFollower){
+		sizeT follower = nextPos(start + len - 1);
+		_intervalSum.removeBetween(timeArr[start + len - 1], timeArr[follower]);
+		if (_tracksIntervals) _intervalIndex.remove(follower, intervals[follower]);
+	}
 }
 
-//returns time of oldest item
-template<typename T, typename timeT, typename resultingT>
-timeT qmedianbuffer<T, timeT, resultingT>::peekTime() {
-	return peekItem()->time;
+//n entries at once, the same as n push() calls, with times from array
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::pushMany(const T *numbers, const timeT *timestamps, unsigned long n) {
+	pushBatch(numbers, n, arrayTimes{ timestamps });
 }
 
-template<typename T, typename timeT, typename resultingT>
-typename qmedianbuffer<T, timeT, resultingT>::itemQ* qmedianbuffer<T, timeT, resultingT>::peekItem() {
+//n entries at once, sampled at uniform period from firstTime on
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::pushMany(const T *numbers, unsigned long n, timeT firstTime, timeT period) {
+	pushBatch(numbers, n, periodicTimes{ firstTime, period });
+}
+
+/*
+batch is copied to ring in (at most) two contiguous spans, head and tail move once;
+entries that would be overwritten leave first, so only free places are written,
+and then companions (order index, sum, min/max, intervals) take new entries one by one
+*/
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<typename timesT>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::pushBatch(const T *numbers, unsigned long n, const timesT &timeAt) {
+	if (n == 0) return;
+	_pushCount += (sizeT)n; //wraps as it would with n push() calls
+
+	unsigned long first = 0;
+	if (n >= getCapacity()){
+		//only last <capacity> entries stay, so older ones are never written
+		first = n - getCapacity();
+		clear();
+	}
+	sizeT len = (sizeT)(n - first);
+	sizeT freePlaces = getCapacity() - getCount();
+	if (len > freePlaces) dropOldest(len - freePlaces);
+	bool hasPrevious = !isEmpty(); //newest entry stays, so first new one has interval to it
+
+	T *valueArr = values.data();
+	timeT *timeArr = times.data();
+	sizeT start = _head;
+	sizeT firstLen, secondLen;
+	getSpans(start, len, firstLen, secondLen);
+	for (sizeT i = 0; i < firstLen; i++){
+		valueArr[start + i] = numbers[first + i];
+		timeArr[start + i] = timeAt(first + i);
+	}
+	for (sizeT i = 0; i < secondLen; i++){
+		valueArr[i] = numbers[first + firstLen + i];
+		timeArr[i] = timeAt(first + firstLen + i);
+	}
+	addToCompanions(start, firstLen, hasPrevious);
+	addToCompanions(0, secondLen, true);
+
+	_head = secondLen > 0 ? secondLen : start + firstLen;
+	if (_head == getCapacity()) _head = 0;
+	_isFull = _head == _tail;
+}
 
-	itemQ* item = getItemAtPositionPtr(0);
-	return item;
+//entries in contiguous span [start, start + len) join companions; hasPrevious if entry before span is in buffer
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::addToCompanions(sizeT start, sizeT len, bool hasPrevious) {
+	if (len == 0) return;
+	T *valueArr = values.data();
+	_sum.addSpan(valueArr + start, len);
+	for (sizeT pos = start; pos < start + len; pos++){
+		_index.add(pos, valueArr[pos]);
+	}
+	if (_minMax.isActive()){
+		for (sizeT pos = start; pos < start + len; pos++) _minMax.add(pos, valueArr[pos], valueArr);
+	}
+	const timeT *timeArr = times.data();
+	if (hasPrevious){
+		timeT interval = _intervalSum.between(timeArr[prevPos(start)], timeArr[start]);
+		_intervalSum.add(interval);
+		if (_tracksIntervals){
+			intervals[start] = interval;
+			_intervalIndex.add(start, interval);
+		}
+	}
+	for (sizeT pos = start + 1; pos < start + len; pos++){
+		timeT interval = _intervalSum.between(timeArr[pos - 1], timeArr[pos]);
+		_intervalSum.add(interval);
+		if (_tracksIntervals){
+			intervals[pos] = interval;
+			_intervalIndex.add(pos, interval);
+		}
+	}
+}
+
+//returns value of oldest item
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::peek() const {
+	if (isEmpty()) return T();
+	return values[_tail];
+}
+
+//returns time of oldest item
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+timeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::peekTime() const {
+	if (isEmpty()) return timeT();
+	return times[_tail];
 }
 
 //deletes one item, older then current time - interval
-template<typename T, typename timeT, typename resultingT>
-bool qmedianbuffer<T, timeT, resultingT>::deleteOld(timeT currentTimeStamp, timeT interval) {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+bool qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::deleteOld(timeT currentTimeStamp, timeT interval) {
 
 	if (isEmpty()){
 		return false;
@@ -275,319 +1698,472 @@ bool qmedianbuffer<T, timeT, resultingT>::deleteOld(timeT currentTimeStamp, time
 	return false;
 }
 
-//never deletes, only resets counter, sorting is only between tail and tail+len
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::clear() {
+//never deletes, only resets counter
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::clear() {
 	_head = _tail;
 	_isFull = false;
+	_index.clear();
+	_sum.clear();
+	_intervalSum.clear();
+	if (_minMax.isActive()) _minMax.clear();
+	if (_tracksIntervals) _intervalIndex.clear();
 }
 
-template<typename T, typename timeT, typename resultingT>
-bool qmedianbuffer<T, timeT, resultingT>::isFull() {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+bool qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::isFull() const {
 	return _isFull;
 }
 
 //tests if empty, and returns (mem consumption remains the same)
-template<typename T, typename timeT, typename resultingT>
-bool qmedianbuffer<T, timeT, resultingT>::isEmpty() {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+bool qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::isEmpty() const {
 	return (!_isFull && (_head == _tail));
 }
 
 //returns freshly calculated count, each time called
-template<typename T, typename timeT, typename resultingT>
-uint8_t qmedianbuffer<T, timeT, resultingT>::getCount() {
-	uint8_t retCount = _capacity;
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::getCount() const {
+	sizeT retCount = getCapacity();
 	if (!_isFull){
 		if (_head >= _tail){
 			retCount = (_head - _tail);
 		}
 		else{
-			retCount = _capacity + _head - _tail;
+			retCount = getCapacity() + _head - _tail;
 		}
 	}
 	return retCount;
 }
 
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::getCapacity() const {
+	return fixedCapacity ? fixedCapacity : _capacity;
+}
+
 //returns simple count of push operations
-template<typename T, typename timeT, typename resultingT>
-uint8_t qmedianbuffer<T, timeT, resultingT>::getPushCount(){
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::getPushCount() const{
 	return _pushCount;
 }
 
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::resetPushCount(){
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::resetPushCount(){
 	_pushCount = 0;
 }
 
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::spans(const T *&first, sizeT &firstLen, const T *&second, sizeT &secondLen) const {
+	getSpans(firstLen, secondLen);
+	first = values.data() + _tail;
+	second = values.data();
+}
 
-//------helper function to get pointer to item at position-----
 
-template<typename T, typename timeT, typename resultingT>
-typename qmedianbuffer<T, timeT, resultingT>::itemQ* qmedianbuffer<T, timeT, resultingT>::getItemAtPositionPtr(uint8_t position) {
+//------helper functions for positions in ring-----
 
-	itemQ *item;
+//entries are values[_tail..] and then values[0..]; lengths of those two contiguous spans
+//(second is 0 when entries do not wrap), so scans run over plain arrays without wrapping each position
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::getSpans(sizeT &firstLen, sizeT &secondLen) const {
+	getSpans(_tail, getCount(), firstLen, secondLen);
+}
 
-	if (position == 0){ //micro optimisation
-		item = &items[_tail];
-	}
-	else{
-		uint8_t realPosition = (_tail + position) % _capacity; //micro optimisation exists for this also, but reduces readability
-		item = &items[realPosition];
-	}
+//the same for any len entries from position start on
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::getSpans(sizeT start, sizeT len, sizeT &firstLen, sizeT &secondLen) const {
+	sizeT toEnd = getCapacity() - start;
+	firstLen = len < toEnd ? len : toEnd;
+	secondLen = len - firstLen;
+}
 
-	if (isEmpty()){
-		itemQ emptyItem{};
-		item = &emptyItem;//clear it, and return clean one; to array also, although it does not matter there
+//position after this one, wrapped to the beginning at the end of array
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::nextPos(sizeT pos) const {
+	if (isPowerOfTwo){
+		return (pos + 1) & (fixedCapacity - 1);
 	}
-	return item;
+	pos++;
+	return pos == getCapacity() ? 0 : pos;
 }
 
+//position before this one, wrapped to the end at the beginning of array
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::prevPos(sizeT pos) const {
+	if (isPowerOfTwo){
+		return (pos - 1) & (fixedCapacity - 1);
+	}
+	return pos == 0 ? getCapacity() - 1 : pos - 1;
+}
 
-//------predicates to pass as function to get value for sorting-----
 
-//predicate to pass to quick select algorithm to sort by value
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::getItemValue(const itemQ &item) {
-	return item.value;
-}
+//----------------scratch functions-------------
+/*
+statistics that need values in order work on a copy in scratch array of that query (see qscratch);
+entries keep their insert order, and values are never replaced, so after any interval
+function values are still good, and no reordering back is needed
+*/
 
-//predicate to pass to sort algorithm to sort by initial order
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::getItemInsertOrder(const itemQ &item) {
-	return (T)item.insertOrder; //casting needed for uniformity in sort
+//copy values to scratch, returns count of them
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::valuesToScratch(T *scratch) const {
+	sizeT firstLen, secondLen;
+	getSpans(firstLen, secondLen);
+	const T *src = values.data();
+	T *dst = scratch;
+	for (sizeT i = 0; i < firstLen; i++) dst[i] = src[_tail + i];
+	for (sizeT i = 0; i < secondLen; i++) dst[firstLen + i] = src[i];
+	return firstLen + secondLen;
 }
 
+//calculate intervals between items in sequence to scratch, returns count of them (len - 1)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::intervalsToScratch(T *scratch) const {
 
-//----------------order functions-------------
+	sizeT len = getCount();
+	if (len < 2) return 0;
 
-//call this to prepare array to sort it back to the original order later
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::resetItemOrderOldestToZero() {
-	//must be in insert sequence prior to this!
-	for (uint8_t i = 0; i < getCount(); i++){
-		itemQ *item = getItemAtPositionPtr(i);
-		item->insertOrder = i;
+	/*
+	only intervals between items are measured, and they should be in sequence
+	there can be only len - 1 intervals
+	*/
+	if (_tracksIntervals){
+		//already in interval ring, from entry after oldest one; copied in two spans, as values
+		sizeT start = nextPos(_tail);
+		sizeT toEnd = getCapacity() - start;
+		sizeT firstLen = (len - 1) < toEnd ? (len - 1) : toEnd;
+		const timeT *src = intervals.data();
+		T *dst = scratch;
+		for (sizeT i = 0; i < firstLen; i++) dst[i] = src[start + i]; //make sure <T> is big enough to hold interval
+		for (sizeT i = firstLen; i < len - 1; i++) dst[i] = src[i - firstLen];
+		return len - 1;
 	}
-}
-
-//back to input sequence, from numbers saved within each item
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::sortToInsertSequence() {
-	if (!isEmpty()){
-		sort(_tail, getCount(), items, _capacity, getItemInsertOrder);
+	timeT timePrev = times[_tail];
+	for (sizeT i = 1; i < len; i++){
+		timeT timeNext = times[getTruePos(i, _tail, getCapacity())];
+		timeT intervalDifference = (timeNext - timePrev);
+		scratch[i - 1] = intervalDifference; //make sure <T> is big enough to hold intervaldiff
+		timePrev = timeNext;
 	}
+	return len - 1;
 }
 
-//sort array order by values;
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::sortToValues(uint8_t len) {
-	if (!isEmpty()){
-		resetItemOrderOldestToZero();
-		sort(_tail, len, items, _capacity, getItemValue);
+//put values around median in their place, others are only on the correct side of them
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::selectInScratch(T *scratch, sizeT len, sizeT maxDistanceFromMedian) {
+	if (len == 0) return;
+
+	sizeT startpos, total;
+	medianBand(len, maxDistanceFromMedian, startpos, total);
+
+	//first and last of band are selected, so all between them belong to band too;
+	//their order is not important for averaging, so they are not sorted
+	select(scratch, 0, len, startpos);
+	if (total > 1){
+		select(scratch, startpos + 1, len, startpos + total - 1);
 	}
 }
 
 
-//--------fill values with interval between sequential items----------
+//---------------order index helpers------------------
 
-//calculate intervals between items in sequence
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::intervalsToValues() {
+//true if order index can tell all ranks medianAverage needs, so no selecting is needed
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<typename orderT>
+bool qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::indexHasBand(const orderT &index, sizeT len, sizeT maxDistanceFromMedian) {
+	if (len == 0) return false;
 
-	if (!valuesAreGoodIntervals){
-
-		if (getCount() < 2)	return; //or array error in loop
-		/*
-		only intervals between items are measured, and they should be in sequence
-		result is written in previous item as value, so we are only measuring occurence
-		there can be only len - 1 intervals
-		*/
-		itemQ* itemPrev = getItemAtPositionPtr(0); //tail
-		for (uint8_t i = 1; i < getCount(); i++){
-			itemQ *itemNext = getItemAtPositionPtr(i);
-			timeT intervalDifference = (itemNext->time - itemPrev->time);
-			itemPrev->value = intervalDifference; //make sure .value <T> is big enough to hold intervaldiff
-			itemPrev = nullptr;
-			itemPrev = itemNext;
-			i = i;
-		}
-		itemPrev->value = 0; //but median should ignore it anyway
-		valuesAreGoodIntervals = true;
-	}
+	sizeT startpos, total;
+	medianBand(len, maxDistanceFromMedian, startpos, total);
+	return index.hasRanks(startpos, total);
 }
 
 
 //-----------statistical functions-------------
 
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::minValue() {
-
-	T tempMinV = getItemAtPositionPtr(0)->value; //set default value (0)
-
-	for (uint8_t i = 1; i < getCount(); i++)
-	{
-		T testValue = getItemAtPositionPtr(i)->value;
-		if (testValue < tempMinV) tempMinV = testValue;
-	}
-
-	return tempMinV;
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::minValue() const {
+	T minV, maxV;
+	minMax(minV, maxV);
+	return minV;
 }
 
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::maxValue() {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::maxValue() const {
+	T minV, maxV;
+	minMax(minV, maxV);
+	return maxV;
+}
 
-	T tempMaxV = getItemAtPositionPtr(0)->value;//set default value (0)
+//max - min value, statistical function
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::range() const
+{
+	T minV, maxV;
+	minMax(minV, maxV);
+	return maxV - minV;
+}
 
-	for (uint8_t i = 1; i < getCount(); i++)
-	{
-		T testValue = getItemAtPositionPtr(i)->value;
-		if (testValue > tempMaxV) tempMaxV = testValue;
+//min and max read from sliding min/max if it is tracked, else in one pass over both spans of ring
+//(see qspanminmax); both are T() when empty
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::minMax(T &minV, T &maxV) const {
+	minV = maxV = T();
+	if (isEmpty()) return;
+
+	if (_minMax.isActive()){
+		minV = values[_minMax.minPos()];
+		maxV = values[_minMax.maxPos()];
+		return;
 	}
-	return 	tempMaxV;
+
+	sizeT firstLen, secondLen;
+	getSpans(firstLen, secondLen);
+	const T *arr = values.data();
+	minV = maxV = arr[_tail];
+	qspanminmax<T>::scan(arr + _tail, firstLen, minV, maxV);
+	qspanminmax<T>::scan(arr, secondLen, minV, maxV);
 }
 
-//max - min value, statistical function
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::range()
-{
-	return maxValue() - minValue();
+//sum again from values in buffer (floating sum after infinity was removed, see qrunningsum)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::rebuildSum() {
+	_sum.clear();
+	for (sizeT i = 0; i < getCount(); i++){
+		_sum.add(values[getTruePos(i, _tail, getCapacity())]);
+	}
 }
 
 
 //number of occurence of value within buffer, with difference less then epsilon
-template<typename T, typename timeT, typename resultingT>
-uint8_t qmedianbuffer<T, timeT, resultingT>::occurenceOfValue(T testValue, T epsilon)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::occurenceOfValue(T testValue, T epsilon) const
 {
-	uint8_t nOfTimes = 0;
-	for (uint8_t i = 0; i < getCount(); i++){
-
-		T arrayValue = getItemAtPositionPtr(i)->value;
-		/*
-		since standard abs(x) function doesn't work with integers,
-		and we may not care at the moment to cast to <resultingT>, use this macro
-		*/
-		if (absX(arrayValue - testValue) < epsilon) nOfTimes++;
+	sizeT firstLen, secondLen;
+	getSpans(firstLen, secondLen);
+	const T *arr = values.data();
+	sizeT nOfTimes = 0;
+	/*
+	since standard abs(x) function doesn't work with integers,
+	and we may not care at the moment to cast to <resultingT>, use this macro
+	*/
+	for (sizeT i = 0; i < firstLen; i++){
+		if (absX(arr[_tail + i] - testValue) < epsilon) nOfTimes++;
+	}
+	for (sizeT i = 0; i < secondLen; i++){
+		if (absX(arr[i] - testValue) < epsilon) nOfTimes++;
 	}
 	return nOfTimes;
 }
 
 //number of occurence of value within buffer, with difference always less then epsilon, devided by count
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::frequencyOfValue(T testValue, T epsilon)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::frequencyOfValue(T testValue, T epsilon) const
 {
-	return (resultingT)occurenceOfValue(testValue, epsilon) / getCount();
+	return (resultingT)occurenceOfValue(testValue, epsilon) / (resultingT)getCount();
 }
 
 //mean absolute deviation around calculated average of all
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::meanAbsoluteDeviationAroundAverage()
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::meanAbsoluteDeviationAroundAverage() const
 {
-	return _meanAbsoluteDeviationAroundAverage(_tail, getCount(), items, _capacity, getItemValue);
+	return _meanAbsoluteDeviationAroundAverage(getCount(), average(), ringValues{ _tail, values.data(), getCapacity() });
 }
 
 //mean absolute deviation ardound medianaverage
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::meanAbsoluteDeviationAroundMedianAverage(uint8_t maxDistanceFromMedian)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::meanAbsoluteDeviationAroundMedianAverage(sizeT maxDistanceFromMedian) const
 {
-	sortToValues(getCount());
-	resultingT retVal = _meanAbsoluteDeviationAroundMedianAverage(_tail, getCount(), maxDistanceFromMedian, items, _capacity, getItemValue);
-	sortToInsertSequence();
-	return retVal;
+	sizeT length = getCount();
+	if (indexHasBand(_index, length, maxDistanceFromMedian)){
+		return _meanAbsoluteDeviationAroundMedianAverage(length, maxDistanceFromMedian, indexedValues{ &_index });
+	}
+
+	scratchT scratch(length);
+	valuesToScratch(scratch.data());
+	selectInScratch(scratch.data(), length, maxDistanceFromMedian);
+	return _meanAbsoluteDeviationAroundMedianAverage(length, maxDistanceFromMedian, scratchValues{ scratch.data() });
 }
 
 //original, unchanged median value
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::median() {
-	sortToValues(getCount());
-	T retVal = _median(_tail, getCount(), items, _capacity, getItemValue);
-	sortToInsertSequence();
-	return retVal;
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::median() const {
+	sizeT length = getCount();
+	if (indexHasBand(_index, length, 0)){
+		return _median(length, indexedValues{ &_index });
+	}
+
+	scratchT scratch(length);
+	valuesToScratch(scratch.data());
+	selectInScratch(scratch.data(), length, 0);
+	return _median(length, scratchValues{ scratch.data() });
 }
 
 //shortcut to average of median and all points in range +-length/4
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::medianAverage() {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianAverage() const {
 	return medianAverage(getCount() / 4);
 }
 
 //average of median and -+points at distance
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::medianAverage(uint8_t maxDistanceFromMedian) {
-	sortToValues(getCount());
-	resultingT retVal = _medianAverage(_tail, getCount(), maxDistanceFromMedian, items, _capacity, getItemValue);
-	sortToInsertSequence();
-	return retVal;
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianAverage(sizeT maxDistanceFromMedian) const {
+	sizeT length = getCount();
+	if (indexHasBand(_index, length, maxDistanceFromMedian)){
+		return _medianAverage(length, maxDistanceFromMedian, indexedValues{ &_index });
+	}
+
+	scratchT scratch(length);
+	valuesToScratch(scratch.data());
+	selectInScratch(scratch.data(), length, maxDistanceFromMedian);
+	return _medianAverage(length, maxDistanceFromMedian, scratchValues{ scratch.data() });
 }
 
 //if items in buffer are type of occurence, of no important value
 //then measure average interval (at least 2 items to make any sense)
-//intervals are written to .value field, and original .value is lost
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::medianInterval() {
+//intervals are calculated in scratch, values in buffer stay as they are;
+//with QMEDIANBUFFER_TRACK_INTERVALS and an order index, they are read from interval order index
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianInterval() const {
+
+	sizeT len = getCount();
+	if (_tracksIntervals && len > 1 && indexHasBand(_intervalIndex, len - 1, 0)){
+		return _median(len - 1, indexedIntervals{ &_intervalIndex });
+	}
+	scratchT scratch(len);
+	sizeT length = intervalsToScratch(scratch.data());
+	if (length == 0) return T();
 
-	uint8_t length = getCount();
-	if (length < 2)	return T();
+	selectInScratch(scratch.data(), length, 0);
+	return _median(length, scratchValues{ scratch.data() });
+}
 
-	intervalsToValues();		//will not run if already done
-	sortToValues(length - 1);	//the last one does not cointain interval
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianAverageInterval(sizeT maxDistanceFromMedian) const {
 
-	//check all, but ignore last one, it should be 0!
-	T retVal = _median(_tail, length - 1, items, _capacity, getItemValue);
+	sizeT len = getCount();
+	if (_tracksIntervals && len > 1 && indexHasBand(_intervalIndex, len - 1, maxDistanceFromMedian)){
+		return _medianAverage(len - 1, maxDistanceFromMedian, indexedIntervals{ &_intervalIndex });
+	}
+	scratchT scratch(len);
+	sizeT length = intervalsToScratch(scratch.data());
+	if (length == 0) return resultingT();
 
-	sortToInsertSequence();
-	return retVal;
+	selectInScratch(scratch.data(), length, maxDistanceFromMedian);
+	return _medianAverage(length, maxDistanceFromMedian, scratchValues{ scratch.data() });
 }
 
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::medianAverageInterval(uint8_t maxDistanceFromMedian) {
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianRateOfChange() const {
+	if (getCount() < 2)	return resultingT();
+	resultingT interval = (resultingT)medianInterval();
+	if (interval == 0) return resultingT(); //entries at the same time, as P² and sketch do
+	return 1 / interval;
+}
 
-	uint8_t length = getCount();
-	if (length < 2)	return resultingT();
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianAverageRateOfChange(sizeT maxDistanceFromMedian) const {
+	if (getCount() < 2)	return resultingT();
+	resultingT interval = medianAverageInterval(maxDistanceFromMedian);
+	if (interval == 0) return resultingT();
+	return 1 / interval;
+}
 
-	intervalsToValues();	//will not run if already done
-	sortToValues(length - 1);
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::average() const {
+	//read from running sum, kept on each push and pop
+	if (isEmpty()) return resultingT();
+	return _sum.template average<resultingT>(getCount());
+}
 
-	//check all, but ignore last one, it should be 0!
-	resultingT retVal = _medianAverage(_tail, length - 1, maxDistanceFromMedian, items, _capacity, getItemValue);
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::averageInterval() const {
 
-	sortToInsertSequence();
-	return retVal;
-}
+	sizeT len = getCount();
+	if (len < 2) return resultingT();
 
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::medianRateOfChange() {
-	if (getCount() < 2)	return resultingT();
-	return 1 / (resultingT)medianInterval();
+	//read from sum of intervals, kept on each push and pop (newest - oldest time would wrap with narrow <timeT>)
+	return _intervalSum.template average<resultingT>(len - 1);
 }
 
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::medianAverageRateOfChange(uint8_t maxDistanceFromMedian) {
-	if (getCount() < 2)	return resultingT();
-	return 1 / medianAverageInterval(maxDistanceFromMedian);
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::averageRateOfChange() const {
+	sizeT len = getCount();
+	if (len < 2) return resultingT();
+	return _intervalSum.template rate<resultingT>(len - 1);
 }
 
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::average() {
-	//average does not shuffle order of items
-	return _average(_tail, getCount(), items, _capacity, getItemValue);
-}
 
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::averageInterval() {
+//all value statistics at once; medianAverage as with medianAverage()
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+typename qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::statistics qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::stats() const {
+	return stats(getCount() / 4);
+}
 
-	uint8_t length = getCount();
-	if (length < 2)	return resultingT();
+/*
+values are copied to scratch in one scan, and min, max and deviation from average (known from
+running sum) are taken on the way; then median band is selected once (or read from order index),
+and median is selected only among values inside of band
+*/
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+typename qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::statistics qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::stats(sizeT maxDistanceFromMedian) const {
+	statistics st{};
+	sizeT len = getCount();
+	st.count = len;
+	if (len == 0) return st;
+
+	st.average = average();
+	st.minValue = st.maxValue = values[_tail];
+	sizeT firstLen, secondLen;
+	getSpans(firstLen, secondLen);
+
+	//index answers median band, so values are only scanned, not copied
+	if (indexHasBand(_index, len, maxDistanceFromMedian)){
+		scanToScratch<false>(values.data() + _tail, firstLen, nullptr, 0, st);
+		scanToScratch<false>(values.data(), secondLen, nullptr, firstLen, st);
+#if !EXPECT_BIG_NUMBERS
+		st.meanAbsoluteDeviationAroundAverage = st.meanAbsoluteDeviationAroundAverage / (resultingT)len;
+#endif
+		st.median = _median(len, indexedValues{ &_index });
+		st.medianAverage = _medianAverage(len, maxDistanceFromMedian, indexedValues{ &_index });
+		return st;
+	}
 
-	intervalsToValues();
+	scratchT scratch(len);
+	scanToScratch<true>(values.data() + _tail, firstLen, scratch.data(), 0, st);
+	scanToScratch<true>(values.data(), secondLen, scratch.data(), firstLen, st);
+#if !EXPECT_BIG_NUMBERS
+	st.meanAbsoluteDeviationAroundAverage = st.meanAbsoluteDeviationAroundAverage / (resultingT)len;
+#endif
 
-	//check all, but ignore last one, it does not cointain interval
-	return _average(_tail, length - 1, items, _capacity, getItemValue);
+	sizeT startpos, total;
+	sizeT distance = maxDistanceFromMedian;
+	medianBand(len, distance, startpos, total);
+	selectInScratch(scratch.data(), len, maxDistanceFromMedian);
+	if (len / 2 > startpos && len / 2 < startpos + total - 1){
+		select(scratch.data(), startpos + 1, startpos + total - 1, len / 2);
+	}
+	st.median = _median(len, scratchValues{ scratch.data() });
+	st.medianAverage = _medianAverage(len, maxDistanceFromMedian, scratchValues{ scratch.data() });
+	return st;
 }
 
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::averageRateOfChange() {
-	if (getCount() < 2)	return resultingT();
-	return 1 / averageInterval();
+//one span of values to scratch from offset on (only if copyValues), with min, max and deviation from average on the way
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<bool copyValues>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::scanToScratch(const T *src, sizeT len, T *scratch, sizeT offset, statistics &st) const {
+	for (sizeT i = 0; i < len; i++){
+		T value = src[i];
+		if (copyValues) scratch[offset + i] = value;
+		if (value < st.minValue) st.minValue = value;
+		if (value > st.maxValue) st.maxValue = value;
+		resultingT deviation = absX((resultingT)value - st.average);
+#if EXPECT_BIG_NUMBERS
+		st.meanAbsoluteDeviationAroundAverage = (deviation - st.meanAbsoluteDeviationAroundAverage) / (resultingT)(offset + i + 1) + st.meanAbsoluteDeviationAroundAverage;
+#else
+		st.meanAbsoluteDeviationAroundAverage = st.meanAbsoluteDeviationAroundAverage + deviation;
+#endif
+	}
 }
 
 
@@ -597,16 +2173,24 @@ NOTE: some averaging parts need ABS(x) function; however if <resultinF> is unsig
 compilation error. So custom absX is provided, since user _may_ want to have median in other values
 */
 
-//helper function to get actual position of item in array, regarding tail (integer overflow calculations)
-template<typename T, typename timeT, typename resultingT>
-uint8_t qmedianbuffer<T, timeT, resultingT>::getTruePos(uint8_t posSeek, uint8_t tail, uint8_t capacity){
-	return (posSeek + tail) % capacity;
+//helper function to get actual position of item in array, regarding tail
+//(posSeek + tail) could overflow <sizeT> for big capacities, so it is never summed up directly
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::getTruePos(sizeT posSeek, sizeT tail, sizeT capacity){
+	if (isPowerOfTwo){
+		return (posSeek + tail) & (fixedCapacity - 1); //wraps the same even if sum overflows
+	}
+	if (posSeek < capacity - tail){
+		return posSeek + tail;
+	}
+	return posSeek - (capacity - tail);
 }
 
 
 //standard average function
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::_average(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate)){
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<typename valuesT>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::_average(sizeT len, const valuesT &values){
 
 	/*
 	this will average numbers, trying to avoid overflow;
@@ -614,61 +2198,68 @@ resultingT qmedianbuffer<T, timeT, resultingT>::_average(uint8_t tail, uint8_t l
 	*/
 	resultingT avg{};
 
-	for (uint8_t i = 0; i < len; i++){
-		resultingT itemValue = (resultingT)getSortValueFunc(arr[getTruePos(i, tail, arrCapacity)]);
+	for (sizeT i = 0; i < len; i++){
+		resultingT itemValue = (resultingT)values(i);
 #if EXPECT_BIG_NUMBERS
-		avg = (itemValue - avg) / (i + 1) + avg; //simple approach to try to avoid overflow with big numbers; use double type if needed more precision
+		avg = (itemValue - avg) / (resultingT)(i + 1) + avg; //simple approach to try to avoid overflow with big numbers; use double type if needed more precision
 	}
 #else		
 		avg = avg + itemValue; //use double type, or any bigger type, big enough to hold sum of array, since it will owerflow
 	}
-	avg = avg / len;
+	avg = avg / (resultingT)len;
 #endif		
 	return avg;
 }
 
 //mean absolute deviation around average
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::_meanAbsoluteDeviationAroundAverage(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate))
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<typename valuesT>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::_meanAbsoluteDeviationAroundAverage(sizeT len, resultingT avg, const valuesT &values)
 {
-	resultingT avg = _average(tail, len, arr, arrCapacity, getSortValueFunc);
 	resultingT mada = 0;
 
-	for (uint8_t i = 0; i < len; i++){
-		resultingT arrayValue = (resultingT)getSortValueFunc(arr[getTruePos(i, tail, arrCapacity)]);
+	for (sizeT i = 0; i < len; i++){
+		resultingT arrayValue = (resultingT)values(i);
 #if EXPECT_BIG_NUMBERS
-		mada = (absX(arrayValue - avg) - mada) / (i + 1) + mada;
+		mada = (absX(arrayValue - avg) - mada) / (resultingT)(i + 1) + mada;
 	}
 #else
 		mada = absX(arrayValue - avg) + mada;
 	}
-	mada = mada / len;
+	mada = mada / (resultingT)len;
 #endif	
 	return mada;
 }
 
 //pick median in previously sorted array; always original numeric value, no averaging at any time
-template<typename T, typename timeT, typename resultingT>
-T qmedianbuffer<T, timeT, resultingT>::_median(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate)){
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<typename rankedT>
+T qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::_median(sizeT len, const rankedT &ranked){
 	if (len == 0) {
 		return T();
 	}
 	if (len == 1) {
-		return getSortValueFunc(arr[getTruePos(0, tail, arrCapacity)]);
+		return ranked(0);
 	}
 	// else, always pick at least one original value
-	return getSortValueFunc(arr[getTruePos(len / 2, tail, arrCapacity)]);
+	return ranked(len / 2);
+}
+
+//positions around median, at max distance from it (see qmedianband)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianBand(sizeT len, sizeT &maxDistanceFromMedian, sizeT &startpos, sizeT &total){
+	qmedianband(len, maxDistanceFromMedian, startpos, total);
 }
 
 //pick median, and average with surrounding numbers with max distance of it
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::_medianAverage(uint8_t tail, uint8_t len, uint8_t maxDistanceFromMedian, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate)){
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<typename rankedT>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::_medianAverage(sizeT len, sizeT maxDistanceFromMedian, const rankedT &ranked){
 
 	/*
 	median is in the middle of sorted array
 	start at the -maxdistance, go over median, and finish at +maxdistance
 	average numbers and return; if len is even, then median is middle of two middle numbers
-	that means that in case of len = 6, distance = 1, evaluated array items are => | 0, 1, (1, 1), 1, 0 |; total = 4
 	this function can be used for averaging if needed, where max distance = len/2
 	*/
 
@@ -676,43 +2267,38 @@ resultingT qmedianbuffer<T, timeT, resultingT>::_medianAverage(uint8_t tail, uin
 		return resultingT();
 	}
 	if (len == 1) {
-		return (resultingT)getSortValueFunc(arr[getTruePos(0, tail, arrCapacity)]);
+		return (resultingT)ranked(0);
 	}
 
-	uint8_t evenNumCorrection = 0;
-	if (len % 2 == 0) evenNumCorrection = 1;
-
-	if (maxDistanceFromMedian > len / 2) maxDistanceFromMedian = len / 2;
-	uint8_t startpos = len / 2 - maxDistanceFromMedian - evenNumCorrection; //so middle is found, start earlier
-	uint8_t total = 1 + 2 * maxDistanceFromMedian + evenNumCorrection; //so middle is found, it is one more
+	sizeT startpos, total;
+	medianBand(len, maxDistanceFromMedian, startpos, total);
 
 	resultingT avgN{}, mPosition;
 
-	for (uint8_t i = 0; i < total; i++){
-		mPosition = (resultingT)getSortValueFunc(arr[getTruePos(startpos + i, tail, arrCapacity)]); //position up
+	for (sizeT i = 0; i < total; i++){
+		mPosition = (resultingT)ranked(startpos + i); //position up
 #if EXPECT_BIG_NUMBERS			
-		avgN = (mPosition - avgN) / (i + 1) + avgN; //simple approach to try to avoid overflow with big numbers; use double type if needed more precision
+		avgN = (mPosition - avgN) / (resultingT)(i + 1) + avgN; //simple approach to try to avoid overflow with big numbers; use double type if needed more precision
 	}
 #else
 		avgN = mPosition + avgN;
 	}
 	//and finaly
-	avgN = avgN / total;
+	avgN = avgN / (resultingT)total;
 #endif
 
 	return avgN;
 }
 
 //pick median, and average with surrounding numbers with max distance of it
-template<typename T, typename timeT, typename resultingT>
-resultingT qmedianbuffer<T, timeT, resultingT>::_meanAbsoluteDeviationAroundMedianAverage(uint8_t tail, uint8_t len, uint8_t maxDistanceFromMedian, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate)){
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+template<typename rankedT>
+resultingT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::_meanAbsoluteDeviationAroundMedianAverage(sizeT len, sizeT maxDistanceFromMedian, const rankedT &ranked){
 
 	/*
 	this is actually simple thing - average of numbers around median!
-	median is in the middle of sorted array, if len is even, then median is middle of two middle numbers
 	start at the -maxdistance, go over median, and finish at +maxdistance
 	average numbers and return
-	that means that in case of len = 6, distance = 1, evaluated array items are => | 0, 1, (1, 1), 1, 0 |; total = 4
 	*/
 
 	if (len < 2) {
@@ -720,28 +2306,24 @@ resultingT qmedianbuffer<T, timeT, resultingT>::_meanAbsoluteDeviationAroundMedi
 	}
 
 	//get median (average using same distance) first
-	resultingT med = _medianAverage(tail, len, maxDistanceFromMedian, arr, arrCapacity, getSortValueFunc); //max dist must be 0 to get real median
+	resultingT med = _medianAverage(len, maxDistanceFromMedian, ranked); //max dist must be 0 to get real median
 
 	//then average all around it at max distance
-	uint8_t evenNumCorrection = 0;
-	if (len % 2 == 0) evenNumCorrection = 1;
-
-	if (maxDistanceFromMedian > len / 2) maxDistanceFromMedian = len / 2;
-	uint8_t startpos = len / 2 - maxDistanceFromMedian - evenNumCorrection; //so middle is found, start earlier
-	uint8_t total = 1 + 2 * maxDistanceFromMedian + evenNumCorrection; //so middle is found, it is one more
+	sizeT startpos, total;
+	medianBand(len, maxDistanceFromMedian, startpos, total);
 
 	resultingT avgMAD{};
 
-	for (uint8_t i = 0; i < total; i++){
-		resultingT mPosition = (resultingT)getSortValueFunc(arr[getTruePos(startpos + i, tail, arrCapacity)]); //position up
+	for (sizeT i = 0; i < total; i++){
+		resultingT mPosition = (resultingT)ranked(startpos + i); //position up
 #if EXPECT_BIG_NUMBERS //simple approach to try to avoid overflow with big numbers; use double type if needed more precision
-		avgMAD = (absX(mPosition - med) - avgMAD) / (i + 1) + avgMAD;
+		avgMAD = (absX(mPosition - med) - avgMAD) / (resultingT)(i + 1) + avgMAD;
 	}
 #else
 		avgMAD = absX(mPosition - med) + avgMAD;
 	}
 	//and finaly
-	avgMAD = avgMAD / total;
+	avgMAD = avgMAD / (resultingT)total;
 #endif
 
 	return avgMAD;
@@ -750,23 +2332,104 @@ resultingT qmedianbuffer<T, timeT, resultingT>::_meanAbsoluteDeviationAroundMedi
 
 //---------------static select and sort functions------------------
 
-//standard insertionSort algorithm, done in one pass
-template<typename T, typename timeT, typename resultingT>
-void qmedianbuffer<T, timeT, resultingT>::sort(uint8_t tail, uint8_t len, itemQ *arr, uint8_t arrCapacity, T(*getSortValueFunc)(const itemQ &objToEvaluate)) {
+//standard insertionSort algorithm, done in one pass; used only for groups of 5 items now
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::sort(T *arr, sizeT len) {
 
 	int j; //needs to be signed since in while loop, it will become -1 to exit while
-	itemQ tmp;
-	for (uint8_t i = 1; i < len; i++)
+	T tmp;
+	for (sizeT i = 1; i < len; i++)
 	{
-		tmp = arr[getTruePos(i, tail, arrCapacity)];
+		tmp = arr[i];
 		j = i - 1;
 
-		while (j >= 0 && getSortValueFunc(arr[getTruePos(j, tail, arrCapacity)]) > getSortValueFunc(tmp))
+		while (j >= 0 && arr[j] > tmp)
 		{
-			arr[getTruePos(j + 1, tail, arrCapacity)] = arr[getTruePos(j, tail, arrCapacity)];
+			arr[j + 1] = arr[j];
 			j = j - 1;
 		}
-		arr[getTruePos(j + 1, tail, arrCapacity)] = tmp;
+		arr[j + 1] = tmp;
+	}
+}
+
+//introselect: quickselect, but if partitioning goes bad for too long, median of medians is used as pivot,
+//so it is O(n) on average and never worse then O(n log n); works only between [first, last) positions
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::select(T *arr, sizeT first, sizeT last, sizeT k) {
+
+	uint8_t depthLimit = 0;
+	for (sizeT n = last - first; n > 1; n /= 2) depthLimit += 2;
+
+	while (last - first > 1){
+		sizeT pivotPos;
+		if (depthLimit > 0){
+			depthLimit--;
+			//median of first, middle and last as pivot
+			sizeT middle = first + (last - first) / 2;
+			T a = arr[first];
+			T b = arr[middle];
+			T c = arr[last - 1];
+			if (a < b){
+				pivotPos = (b < c) ? middle : ((a < c) ? last - 1 : first);
+			}
+			else{
+				pivotPos = (a < c) ? first : ((b < c) ? last - 1 : middle);
+			}
+		}
+		else{
+			pivotPos = medianOfMedians(arr, first, last);
+		}
+		T pivot = arr[pivotPos];
+
+		//three way partition, so many equal values (common with small types) do not slow it down
+		//[first, lower) smaller, [lower, upper) equal, [upper, last) bigger then pivot
+		sizeT lower = first, i = first, upper = last;
+		while (i < upper){
+			if (arr[i] < pivot){
+				swapValues(arr, lower++, i++);
+			}
+			else if (pivot < arr[i]){
+				swapValues(arr, i, --upper);
+			}
+			else{
+				i++;
+			}
+		}
+
+		if (k < lower){
+			last = lower;
+		}
+		else if (k >= upper){
+			first = upper;
+		}
+		else{
+			return; //k is among values equal to pivot
+		}
+	}
+}
+
+//groups of 5 are sorted, their medians moved to front, and median of them selected; returns its position
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+sizeT qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::medianOfMedians(T *arr, sizeT first, sizeT last) {
+
+	sizeT medians = 0;
+	for (sizeT group = first; group < last; group += 5){
+		sizeT groupLen = (last - group < 5) ? last - group : 5;
+		sort(arr + group, groupLen);
+		swapValues(arr, first + medians, group + groupLen / 2);
+		medians++;
+		if (last - group <= 5) break; //or group would overflow
 	}
+
+	sizeT middle = first + medians / 2;
+	select(arr, first, first + medians, middle);
+	return middle;
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT, sizeT fixedCapacity>
+void qmedianbuffer<T, timeT, resultingT, indexT, sizeT, fixedCapacity>::swapValues(T *arr, sizeT posA, sizeT posB) {
+	T tmp = arr[posA];
+	arr[posA] = arr[posB];
+	arr[posB] = tmp;
 }
 #endif
@@ -0,0 +1,450 @@
+/* Multi-channel circular buffer with median, for many identically configured channels.
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   many channels (ADC inputs, sensors of the same kind) sampled together, each needing
+   its own median. One qmedianbuffer per channel means one allocation, one head and tail,
+   and one selection per channel; here all channels share them.
+
+   Implementation:
+   -all channels share one head, one tail and one ring of timestamps
+   -values are kept by time, channel-interleaved: entry at ring position p is
+   values[p * channels .. p * channels + channels - 1], so each entry is one row
+   -medians of all channels are found at once: rows are copied to scratch, and sorted
+   by a sorting network, where each compare-exchange of two rows is min/max lane by lane
+   across channels (SSE2/AVX2 vectors where available, see qlaneexchange);
+   that way there are no branches, and each channel is one lane
+   -statistics fill an array with one result per channel; averages() are read from a running sum
+   per channel, kept on push and pop (exact for integers, compensated for floating values)
+
+   Note on values:
+   -<T>, <timeT>, <resultingT>, <sizeT> as with qmedianbuffer
+   -each entry is the size of (<T> * channels + <timeT>); median queries take one more (<T> * channels) per entry
+   as scratch of their own (on stack up to QMEDIANBUFFER_STACK_SCRATCH values), so all queries are const
+   -sorting network is O(n log^2 n) compare-exchanges of rows, so it is meant for windows
+   of small to moderate capacity (5-63 entries), with many channels
+   */
+
+#ifndef qmultimedianbuffer_h
+#define qmultimedianbuffer_h
+#include "qmedianbuffer.h"
+#if !defined(ARDUINO)
+#include <cstring>
+#endif
+
+
+//--------------------------------lane compare-exchange-----------------------------------------
+/*
+compare-exchange of two rows, lane by lane: after it, row a has smaller and row b bigger
+value of each lane. Generic version is plain loop; with SSE2/AVX2 (see qspanminmax) there
+are vector versions for 8, 16 and 32 bit integers, <float> and <double>.
+Vector min/max return their second operand when lanes are equal or unordered (NaN), so operands
+are in the order that keeps b in a and a in b in that case, as the loop does; each lane keeps both values.
+*/
+
+template<typename T>
+struct qlaneexchangeLoop
+{
+	static void exchange(T *a, T *b, unsigned long len) {
+		for (unsigned long i = 0; i < len; i++){
+			T x = a[i];
+			T y = b[i];
+			a[i] = y < x ? y : x;
+			b[i] = y < x ? x : y;
+		}
+	}
+};
+
+template<typename T>
+struct qlaneexchange : qlaneexchangeLoop<T> {};
+
+#if QMEDIANBUFFER_SSE2
+
+template<typename ops>
+struct qlaneexchangeVector
+{
+	typedef typename ops::T T;
+	typedef typename ops::V V;
+
+	static void exchange(T *a, T *b, unsigned long len) {
+		unsigned long i = 0;
+		for (; i + ops::lanes <= len; i += ops::lanes){
+			V x = ops::load(a + i);
+			V y = ops::load(b + i);
+			ops::store(a + i, ops::vmin(y, x)); //y < x ? y : x
+			ops::store(b + i, ops::vmax(x, y)); //x > y ? x : y
+		}
+		qlaneexchangeLoop<T>::exchange(a + i, b + i, len - i);
+	}
+};
+
+template<> struct qlaneexchange<uint8_t> : qlaneexchangeVector<qsimdU8> {};
+template<> struct qlaneexchange<int8_t> : qlaneexchangeVector<qsimdI8> {};
+template<> struct qlaneexchange<uint16_t> : qlaneexchangeVector<qsimdU16> {};
+template<> struct qlaneexchange<int16_t> : qlaneexchangeVector<qsimdI16> {};
+template<> struct qlaneexchange<uint32_t> : qlaneexchangeVector<qsimdU32> {};
+template<> struct qlaneexchange<int32_t> : qlaneexchangeVector<qsimdI32> {};
+template<> struct qlaneexchange<float> : qlaneexchangeVector<qsimdF32> {};
+template<> struct qlaneexchange<double> : qlaneexchangeVector<qsimdF64> {};
+
+#endif //QMEDIANBUFFER_SSE2
+
+//-----------------------------------------------------------------------------------------------
+
+
+//<T> numeric data stored; <timeT> strictly UNSIGNED type for incremental time data, <resultingT> return type of math heavy functions
+//<sizeT> UNSIGNED type for capacity, positions and counters; max capacity is its max value
+template<typename T, typename timeT, typename resultingT, typename sizeT = uint8_t>
+class qmultimedianbuffer
+{
+
+#if RESTRICT_TYPES_OF_DATA
+	static_assert(is_type_signed(resultingT), "qmultimedianbuffer: non-recommended type for <resultingT>; should be any signed type (<int>, <float>, <double>...)");
+	static_assert(is_type_unsigned(timeT), "qmultimedianbuffer: non-recommended type for <timeT>; should be any unsigned type (<uint16_t>, <uint32_t>...)");
+	static_assert(is_type_unsigned(sizeT), "qmultimedianbuffer: non-recommended type for <sizeT>; should be any unsigned type (<uint8_t>, <uint16_t>, <uint32_t>...)");
+#endif
+
+public:
+
+	//initiate circular buffer of capacity entries, each with a value for each of channels
+	qmultimedianbuffer(sizeT capacity, uint16_t channels) {
+		_capacity = capacity;
+		_channels = channels;
+		values = new T[(unsigned long)capacity * channels];
+		times = new timeT[capacity];
+		_sums = new qrunningsum<T, sizeT>[channels];
+	}
+
+	~qmultimedianbuffer() {
+		delete[] values;
+		delete[] times;
+		delete[] _sums;
+	}
+
+	void push(const T *channelValues, timeT currentTime);
+	bool pop(); //drops the oldest entry, returns false if empty
+	const T *peek() const; //values of oldest entry, one per channel (nullptr if empty)
+	timeT peekTime() const;
+	void clear();
+
+	bool isFull() const;
+	bool isEmpty() const;
+	sizeT getCount() const;
+	sizeT getCapacity() const;
+	uint16_t getChannels() const;
+	sizeT getPushCount() const;
+	void resetPushCount();
+
+	//each fills out[channel] for all channels
+	void minValues(T *out) const;
+	void maxValues(T *out) const;
+	void averages(resultingT *out) const;
+	void medians(T *out) const;
+	void medianAverages(resultingT *out) const;
+	void medianAverages(resultingT *out, sizeT maxDistanceFromMedian) const;
+
+	//time is shared by all channels
+	resultingT averageInterval() const;
+	resultingT averageRateOfChange() const;
+
+private:
+	T *values = nullptr;
+	timeT *times = nullptr;
+	sizeT _capacity{};
+	uint16_t _channels{};
+	sizeT _head{};
+	sizeT _tail{};
+	bool _isFull{};
+
+	sizeT _pushCount{};
+	qrunningsum<T, sizeT> *_sums = nullptr;	//one per channel, kept on push and pop (see qrunningsum)
+	qintervalsum<timeT, sizeT> _intervalSum;	//of intervals between entries, so span of buffer may wrap
+
+	//rows of one query, oldest first (see qscratch)
+	typedef qscratch<T, QMEDIANBUFFER_STACK_SCRATCH> scratchT;
+
+	T *row(T *arr, sizeT pos) const { return arr + (unsigned long)pos * _channels; }
+	const T *row(const T *arr, sizeT pos) const { return arr + (unsigned long)pos * _channels; }
+	sizeT nextPos(sizeT pos) const;
+	void rebuildSums();
+	void rowsToScratch(T *scratch) const;
+	void sortScratch(T *scratch, sizeT len) const;
+};
+
+
+//------------------pop push peek-----------------
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::push(const T *channelValues, timeT currentTime) {
+	_pushCount++; //non important, user info counter of all push operations
+
+	//new entry has interval to newest one, if that one is not overwritten now (capacity of 1)
+	if (!isEmpty() && _capacity > 1){
+		sizeT newest = _head == 0 ? _capacity - 1 : _head - 1;
+		_intervalSum.addBetween(times[newest], currentTime);
+	}
+	T *dst = row(values, _head);
+	if (_isFull){
+		//entry after oldest one becomes oldest, and has no interval any more
+		if (_capacity > 1) _intervalSum.removeBetween(times[_tail], times[nextPos(_tail)]);
+		for (uint16_t c = 0; c < _channels; c++) _sums[c].remove(dst[c]);
+		_tail = nextPos(_tail); //oldest one is overwritten
+	}
+	bool rebuild = false;
+	for (uint16_t c = 0; c < _channels; c++){
+		dst[c] = channelValues[c];
+		_sums[c].add(dst[c]);
+		rebuild = rebuild || _sums[c].needsRebuild();
+	}
+	times[_head] = currentTime;
+	_head = nextPos(_head);
+	_isFull = _head == _tail;
+	if (rebuild) rebuildSums();
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+bool qmultimedianbuffer<T, timeT, resultingT, sizeT>::pop() {
+	if (isEmpty()) return false;
+
+	bool rebuild = false;
+	if (getCount() > 1){
+		_intervalSum.removeBetween(times[_tail], times[nextPos(_tail)]);
+		const T *src = row(values, _tail);
+		for (uint16_t c = 0; c < _channels; c++){
+			_sums[c].remove(src[c]);
+			rebuild = rebuild || _sums[c].needsRebuild();
+		}
+	}
+	else{
+		//empty now, so no rounding left behind
+		_intervalSum.clear();
+		for (uint16_t c = 0; c < _channels; c++) _sums[c].clear();
+	}
+	_isFull = false; //it will for sure not be full
+	_tail = nextPos(_tail);
+	if (rebuild) rebuildSums();
+	return true;
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+const T *qmultimedianbuffer<T, timeT, resultingT, sizeT>::peek() const {
+	if (isEmpty()) return nullptr;
+	return row(values, _tail);
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+timeT qmultimedianbuffer<T, timeT, resultingT, sizeT>::peekTime() const {
+	if (isEmpty()) return timeT();
+	return times[_tail];
+}
+
+//never deletes, only resets counter
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::clear() {
+	_head = _tail;
+	_isFull = false;
+	_intervalSum.clear();
+	for (uint16_t c = 0; c < _channels; c++) _sums[c].clear();
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+bool qmultimedianbuffer<T, timeT, resultingT, sizeT>::isFull() const {
+	return _isFull;
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+bool qmultimedianbuffer<T, timeT, resultingT, sizeT>::isEmpty() const {
+	return (!_isFull && (_head == _tail));
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+sizeT qmultimedianbuffer<T, timeT, resultingT, sizeT>::getCount() const {
+	if (_isFull) return _capacity;
+	return _head >= _tail ? _head - _tail : _capacity + _head - _tail;
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+sizeT qmultimedianbuffer<T, timeT, resultingT, sizeT>::getCapacity() const {
+	return _capacity;
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+uint16_t qmultimedianbuffer<T, timeT, resultingT, sizeT>::getChannels() const {
+	return _channels;
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+sizeT qmultimedianbuffer<T, timeT, resultingT, sizeT>::getPushCount() const {
+	return _pushCount;
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::resetPushCount() {
+	_pushCount = 0;
+}
+
+
+//------helper functions-----
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+sizeT qmultimedianbuffer<T, timeT, resultingT, sizeT>::nextPos(sizeT pos) const {
+	pos++;
+	return pos == _capacity ? 0 : pos;
+}
+
+//sums from all entries again; only when one became NaN (see qrunningsum)
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::rebuildSums() {
+	for (uint16_t c = 0; c < _channels; c++) _sums[c].clear();
+	sizeT len = getCount();
+	for (sizeT i = 0, pos = _tail; i < len; i++, pos = nextPos(pos)){
+		const T *src = row(values, pos);
+		for (uint16_t c = 0; c < _channels; c++) _sums[c].add(src[c]);
+	}
+}
+
+//rows of buffer to scratch, oldest first (two contiguous spans of ring); memcpy, as compiler
+//can not tell scratch of the query from values, and would copy value by value
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::rowsToScratch(T *scratch) const {
+	sizeT len = getCount();
+	sizeT toEnd = _capacity - _tail;
+	sizeT firstLen = len < toEnd ? len : toEnd;
+
+	unsigned long firstValues = (unsigned long)firstLen * _channels;
+	unsigned long allValues = (unsigned long)len * _channels;
+	memcpy(scratch, row(values, _tail), firstValues * sizeof(T));
+	memcpy(scratch + firstValues, values, (allValues - firstValues) * sizeof(T));
+}
+
+/*
+sorts each channel (column) of first len rows in scratch, with Batcher's odd-even merge sorting network;
+network depends only on len, so all channels go through the same compare-exchanges,
+each done for whole row at once (see qlaneexchange)
+*/
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::sortScratch(T *scratch, sizeT len) const {
+	unsigned long n = len;
+	for (unsigned long p = 1; p < n; p += p){
+		for (unsigned long k = p; k >= 1; k /= 2){
+			for (unsigned long j = k % p; j + k < n; j += k + k){
+				for (unsigned long i = 0; i < k && i + j + k < n; i++){
+					//only pairs within the same block of 2p are compared
+					if ((i + j) / (p + p) == (i + j + k) / (p + p)){
+						qlaneexchange<T>::exchange(row(scratch, (sizeT)(i + j)), row(scratch, (sizeT)(i + j + k)), _channels);
+					}
+				}
+			}
+		}
+	}
+}
+
+
+//-----------statistical functions-------------
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::minValues(T *out) const {
+	sizeT len = getCount();
+	if (len == 0){
+		for (uint16_t c = 0; c < _channels; c++) out[c] = T();
+		return;
+	}
+	const T *first = row(values, _tail);
+	for (uint16_t c = 0; c < _channels; c++) out[c] = first[c];
+	for (sizeT i = 1, pos = nextPos(_tail); i < len; i++, pos = nextPos(pos)){
+		const T *src = row(values, pos);
+		for (uint16_t c = 0; c < _channels; c++){
+			if (src[c] < out[c]) out[c] = src[c];
+		}
+	}
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::maxValues(T *out) const {
+	sizeT len = getCount();
+	if (len == 0){
+		for (uint16_t c = 0; c < _channels; c++) out[c] = T();
+		return;
+	}
+	const T *first = row(values, _tail);
+	for (uint16_t c = 0; c < _channels; c++) out[c] = first[c];
+	for (sizeT i = 1, pos = nextPos(_tail); i < len; i++, pos = nextPos(pos)){
+		const T *src = row(values, pos);
+		for (uint16_t c = 0; c < _channels; c++){
+			if (src[c] > out[c]) out[c] = src[c];
+		}
+	}
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::averages(resultingT *out) const {
+	//read from running sums, kept on each push and pop
+	sizeT len = getCount();
+	for (uint16_t c = 0; c < _channels; c++){
+		out[c] = len == 0 ? resultingT() : _sums[c].template average<resultingT>(len);
+	}
+}
+
+//median of each channel, always original value (for even count, upper of two middle ones, as qmedianbuffer)
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::medians(T *out) const {
+	sizeT len = getCount();
+	if (len == 0){
+		for (uint16_t c = 0; c < _channels; c++) out[c] = T();
+		return;
+	}
+	scratchT scratch((unsigned long)len * _channels);
+	rowsToScratch(scratch.data());
+	sortScratch(scratch.data(), len);
+	const T *middle = row(scratch.data(), len / 2);
+	for (uint16_t c = 0; c < _channels; c++) out[c] = middle[c];
+}
+
+//shortcut to average of median and all points in range +-length/4
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::medianAverages(resultingT *out) const {
+	medianAverages(out, getCount() / 4);
+}
+
+//average of median and -+points at distance, for each channel
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+void qmultimedianbuffer<T, timeT, resultingT, sizeT>::medianAverages(resultingT *out, sizeT maxDistanceFromMedian) const {
+	for (uint16_t c = 0; c < _channels; c++) out[c] = resultingT();
+	sizeT len = getCount();
+	if (len == 0) return;
+
+	scratchT scratch((unsigned long)len * _channels);
+	rowsToScratch(scratch.data());
+	sortScratch(scratch.data(), len);
+	sizeT startpos, total;
+	qmedianband(len, maxDistanceFromMedian, startpos, total);
+	for (sizeT i = 0; i < total; i++){
+		const T *src = row(scratch.data(), startpos + i);
+		for (uint16_t c = 0; c < _channels; c++){
+#if EXPECT_BIG_NUMBERS
+			out[c] = ((resultingT)src[c] - out[c]) / (resultingT)(i + 1) + out[c];
+#else
+			out[c] = out[c] + (resultingT)src[c];
+#endif
+		}
+	}
+#if !EXPECT_BIG_NUMBERS
+	for (uint16_t c = 0; c < _channels; c++) out[c] = out[c] / (resultingT)total;
+#endif
+}
+
+//read from sum of intervals, kept on each push and pop (newest - oldest time would wrap with narrow <timeT>)
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+resultingT qmultimedianbuffer<T, timeT, resultingT, sizeT>::averageInterval() const {
+	sizeT len = getCount();
+	if (len < 2) return resultingT();
+	return _intervalSum.template average<resultingT>(len - 1);
+}
+
+template<typename T, typename timeT, typename resultingT, typename sizeT>
+resultingT qmultimedianbuffer<T, timeT, resultingT, sizeT>::averageRateOfChange() const {
+	sizeT len = getCount();
+	if (len < 2) return resultingT();
+	return _intervalSum.template rate<resultingT>(len - 1);
+}
+#endif
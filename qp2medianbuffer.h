@@ -0,0 +1,226 @@
+/* Running median and percentiles of a whole stream in constant memory (P² algorithm).
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   small boards (or sidecars) that need long-run median and e.g. p90 of a stream, not of a window,
+   and have no RAM to spare even for a small buffer of entries.
+
+   Implementation:
+   -P² (Jain and Chlamtac), extended to <quantileCount> quantiles: 2 * <quantileCount> + 3 markers,
+   at min, at each quantile, halfway between neighbouring quantiles, and at max
+   -each marker keeps its height (estimate of value) and its position (count of values below it);
+   on push, positions above new value move by one, and any marker that is one or more positions off
+   from where its quantile should be is moved by one, and its height adjusted by parabola through
+   its neighbours (or linearly, if parabola would pass a neighbour)
+   -until there is a value for each marker, values are kept sorted and results are exact
+   -push is O(<quantileCount>), memory is fixed; min, max, count and average are exact
+
+   Note on values:
+   -results are estimates (interpolated heights), so median() and quantile() return <resultingT>
+   -estimates converge for stationary streams; for a stream whose distribution shifts they follow it slowly
+   -quantile(q) for q that is not tracked is interpolated between markers, so it is rough
+   */
+
+#ifndef qp2medianbuffer_h
+#define qp2medianbuffer_h
+#include "qmedianbuffer.h"
+
+//<T> numeric data, <timeT> strictly UNSIGNED type for time, <resultingT> type of estimates (float or double),
+//<quantileCount> count of tracked quantiles
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount = 1>
+class qp2medianbuffer
+{
+public:
+	//quantiles from 0 to 1 (exclusive), any order; nullptr tracks evenly spaced ones (0.5 for one quantile)
+	explicit qp2medianbuffer(const resultingT *quantiles = nullptr);
+
+	void push(T number, timeT currentTime);
+	void clear();
+
+	bool isEmpty() const { return _count == 0; }
+	unsigned long getCount() const { return _count; }
+
+	//exact
+	T minValue() const { return _minValue; }
+	T maxValue() const { return _maxValue; }
+	resultingT average() const;
+	resultingT averageInterval() const;
+	resultingT averageRateOfChange() const;
+
+	//estimates
+	resultingT median() const { return quantile((resultingT)0.5); }
+	resultingT quantile(resultingT q) const;
+	resultingT tracked(uint8_t i) const { return quantile(_p[2 * i + 2]); } //i-th tracked quantile, ascending
+	resultingT trackedQuantile(uint8_t i) const { return _p[2 * i + 2]; }
+
+private:
+	static const uint8_t markers = 2 * quantileCount + 3;
+
+	resultingT _p[markers];	//wanted part of values below each marker
+	resultingT _height[markers];	//until markers are filled, values pushed so far, sorted
+	unsigned long _position[markers];
+
+	unsigned long _count{};
+	T _minValue{};
+	T _maxValue{};
+	timeT _lastTime{};
+	qintervalsum<timeT, unsigned long> _intervalSum;	//of intervals between pushes, so lifetime of stream may wrap
+	qrunningsum<T, unsigned long> _sum;
+
+	void adjust(uint8_t i);
+};
+
+//------------------------------------------------------------------------------------
+
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+qp2medianbuffer<T, timeT, resultingT, quantileCount>::qp2medianbuffer(const resultingT *quantiles) {
+	resultingT sorted[quantileCount];
+	for (uint8_t i = 0; i < quantileCount; i++){
+		resultingT q = quantiles ? quantiles[i] : (resultingT)(i + 1) / (resultingT)(quantileCount + 1);
+		uint8_t j = i;
+		while (j > 0 && q < sorted[j - 1]){
+			sorted[j] = sorted[j - 1];
+			j--;
+		}
+		sorted[j] = q;
+	}
+
+	_p[0] = 0;
+	_p[markers - 1] = 1;
+	for (uint8_t i = 0; i < quantileCount; i++){
+		_p[2 * i + 2] = sorted[i];
+		_p[2 * i + 1] = ((i == 0 ? 0 : sorted[i - 1]) + sorted[i]) / 2; //halfway from previous one
+	}
+	_p[markers - 2] = (sorted[quantileCount - 1] + 1) / 2;
+	clear();
+}
+
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+void qp2medianbuffer<T, timeT, resultingT, quantileCount>::clear() {
+	for (uint8_t i = 0; i < markers; i++){
+		_height[i] = 0;
+		_position[i] = i;
+	}
+	_count = 0;
+	_minValue = _maxValue = T();
+	_lastTime = timeT();
+	_intervalSum.clear();
+	_sum.clear();
+}
+
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+void qp2medianbuffer<T, timeT, resultingT, quantileCount>::push(T number, timeT currentTime) {
+	if (_count == 0){
+		_minValue = _maxValue = number;
+	}
+	else{
+		_intervalSum.addBetween(_lastTime, currentTime);
+	}
+	if (number < _minValue) _minValue = number;
+	if (number > _maxValue) _maxValue = number;
+	_lastTime = currentTime;
+	_sum.add(number);
+
+	resultingT x = (resultingT)number;
+	if (_count < markers){
+		//filling markers: insertion into sorted heights
+		uint8_t j = (uint8_t)_count;
+		while (j > 0 && x < _height[j - 1]){
+			_height[j] = _height[j - 1];
+			j--;
+		}
+		_height[j] = x;
+		_count++;
+		return;
+	}
+
+	//markers above new value move one position up; end markers follow min and max
+	uint8_t cell;
+	if (x < _height[0]){
+		_height[0] = x;
+		cell = 0;
+	}
+	else if (!(x < _height[markers - 1])){
+		_height[markers - 1] = x;
+		cell = markers - 2;
+	}
+	else{
+		cell = 0;
+		while (!(x < _height[cell + 1])) cell++;
+	}
+	for (uint8_t i = cell + 1; i < markers; i++) _position[i]++;
+	_count++;
+
+	for (uint8_t i = 1; i < markers - 1; i++) adjust(i);
+}
+
+//moves marker i by one position towards where its quantile should be, if it is off by one or more
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+void qp2medianbuffer<T, timeT, resultingT, quantileCount>::adjust(uint8_t i) {
+	resultingT wanted = _p[i] * (resultingT)(_count - 1);
+	resultingT off = wanted - (resultingT)_position[i];
+	long toNext = (long)(_position[i + 1] - _position[i]);
+	long toPrevious = (long)(_position[i] - _position[i - 1]);
+	int s;
+	if (off >= 1 && toNext > 1) s = 1;
+	else if (off <= -1 && toPrevious > 1) s = -1;
+	else return;
+
+	//piecewise parabolic prediction
+	resultingT h = _height[i];
+	resultingT next = _height[i + 1];
+	resultingT previous = _height[i - 1];
+	resultingT parabolic = h + (resultingT)s / (resultingT)(toNext + toPrevious)
+		* ((resultingT)(toPrevious + s) * (next - h) / (resultingT)toNext
+		+ (resultingT)(toNext - s) * (h - previous) / (resultingT)toPrevious);
+	if (previous < parabolic && parabolic < next){
+		_height[i] = parabolic;
+	}
+	else if (s > 0){
+		_height[i] = h + (next - h) / (resultingT)toNext;
+	}
+	else{
+		_height[i] = h - (h - previous) / (resultingT)toPrevious;
+	}
+	_position[i] += s;
+}
+
+//------------------------------------------------------------------------------------
+//queries
+
+//value at rank (q * count) while values are exact; then height interpolated between markers around q
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+resultingT qp2medianbuffer<T, timeT, resultingT, quantileCount>::quantile(resultingT q) const {
+	if (_count == 0) return resultingT();
+	if (q <= 0) return (resultingT)_minValue;
+	if (q >= 1) return (resultingT)_maxValue;
+	if (_count <= markers){
+		unsigned long k = (unsigned long)(q * (resultingT)_count);
+		return _height[k < _count ? k : _count - 1];
+	}
+
+	uint8_t i = 1;
+	while (i < markers - 1 && _p[i] < q) i++;
+	if (_p[i] == q || _p[i] == _p[i - 1]) return _height[i];
+	return _height[i - 1] + (_height[i] - _height[i - 1]) * (q - _p[i - 1]) / (_p[i] - _p[i - 1]);
+}
+
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+resultingT qp2medianbuffer<T, timeT, resultingT, quantileCount>::average() const {
+	if (_count == 0) return resultingT();
+	return _sum.template average<resultingT>(_count);
+}
+
+//from sum of intervals between pushes (last - first time would wrap on long streams)
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+resultingT qp2medianbuffer<T, timeT, resultingT, quantileCount>::averageInterval() const {
+	if (_count < 2) return resultingT();
+	return _intervalSum.template average<resultingT>(_count - 1);
+}
+
+template<typename T, typename timeT, typename resultingT, uint8_t quantileCount>
+resultingT qp2medianbuffer<T, timeT, resultingT, quantileCount>::averageRateOfChange() const {
+	if (_count < 2) return resultingT();
+	return _intervalSum.template rate<resultingT>(_count - 1);
+}
+#endif
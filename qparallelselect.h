@@ -0,0 +1,354 @@
+/* Median, medianAverage and quantiles of very big qmedianbuffer windows, selected by many threads.
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   windows of millions of entries (e.g. hourly reports), where selecting median in one thread
+   is the slowest part, and there are cores to spare.
+
+   Implementation:
+   -values are read in place, from both contiguous parts of ring (see qmedianbuffer::spans()),
+   split in chunks over threads of qthreadpool (caller thread works too)
+   -for a rank k, a small sample of values at random positions is sorted, and two values around k-th in sample
+   are taken as bounds; in one parallel pass each thread counts values below lower bound and values equal
+   to either bound, and picks only those strictly between bounds, so few values are left to select from,
+   in one thread, even when many values are equal to a bound (k-th is then the bound itself)
+   -if sample was unlucky (k-th is not between bounds), a new sample is drawn; after a few misses in a row,
+   all values are copied and selected (exact anyway)
+   -medianAverage selects both ends of median band, and then sums values between them in one more
+   parallel pass (see qrunningsum), so band of any width costs the same
+
+   Note on values:
+   -needs C++11 <thread>; results are exactly those of qmedianbuffer (medianAverage up to rounding)
+   -buffer must not be changed while selecting; selecting is const, as other queries
+   -for windows smaller then QMEDIANBUFFER_PARALLEL_MIN entries, values are selected in one thread
+   */
+
+#ifndef qparallelselect_h
+#define qparallelselect_h
+#include "qmedianbuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+//below this count, splitting over threads costs more then it saves
+#define QMEDIANBUFFER_PARALLEL_MIN 65536
+
+//------------------------------------------------------------------------------------
+//thread pool
+
+//fixed set of threads, for one run of tasks at a time
+class qthreadpool
+{
+public:
+	//threads working on each run, caller included (so threads - 1 are started); 0 is count of cores
+	explicit qthreadpool(unsigned threads = 0);
+	~qthreadpool();
+
+	unsigned getThreads() const { return _workerCount + 1; }
+
+	//calls task(i) for each i < tasks, spread over threads; returns when all of them are done
+	void run(unsigned tasks, const std::function<void(unsigned)> &task);
+
+private:
+	std::thread *_workers = nullptr;
+	unsigned _workerCount{};
+
+	std::mutex _mutex;
+	std::condition_variable _start;
+	std::condition_variable _done;
+	const std::function<void(unsigned)> *_task = nullptr;
+	unsigned _tasks{};
+	unsigned _next{};
+	unsigned _finished{};
+	unsigned long _generation{};
+	bool _stopping{};
+
+	void work();
+	bool runOne(std::unique_lock<std::mutex> &lock);
+};
+
+inline qthreadpool::qthreadpool(unsigned threads) {
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	_workerCount = threads > 1 ? threads - 1 : 0;
+	_workers = new std::thread[_workerCount];
+	for (unsigned i = 0; i < _workerCount; i++){
+		_workers[i] = std::thread(&qthreadpool::work, this);
+	}
+}
+
+inline qthreadpool::~qthreadpool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_start.notify_all();
+	for (unsigned i = 0; i < _workerCount; i++) _workers[i].join();
+	delete[] _workers;
+}
+
+inline void qthreadpool::run(unsigned tasks, const std::function<void(unsigned)> &task) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_task = &task;
+	_tasks = tasks;
+	_next = 0;
+	_finished = 0;
+	_generation++;
+	lock.unlock();
+	_start.notify_all();
+
+	lock.lock();
+	while (runOne(lock)) {}
+	_done.wait(lock, [this] { return _finished == _tasks; });
+	_task = nullptr;
+}
+
+//takes next task, if any left, and runs it with lock released; lock is held again on return
+inline bool qthreadpool::runOne(std::unique_lock<std::mutex> &lock) {
+	if (_next >= _tasks) return false;
+	unsigned i = _next++;
+	const std::function<void(unsigned)> *task = _task;
+	lock.unlock();
+	(*task)(i);
+	lock.lock();
+	if (++_finished == _tasks) _done.notify_all();
+	return true;
+}
+
+inline void qthreadpool::work() {
+	unsigned long seen = 0;
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;){
+		_start.wait(lock, [&] { return _stopping || _generation != seen; });
+		if (_stopping) return;
+		seen = _generation;
+		while (runOne(lock)) {}
+	}
+}
+
+//------------------------------------------------------------------------------------
+//parallel selection
+
+//<T> values in buffer, <resultingT> type of medianAverage (as with qmedianbuffer)
+template<typename T, typename resultingT>
+class qparallelselect
+{
+public:
+	explicit qparallelselect(qthreadpool &pool) : _pool(pool), _random(std::random_device()()) {}
+
+	//the same values as median(), medianAverage() of buffer
+	template<typename bufferT> T median(const bufferT &buffer);
+	template<typename bufferT> resultingT medianAverage(const bufferT &buffer);
+	template<typename bufferT> resultingT medianAverage(const bufferT &buffer, unsigned long maxDistanceFromMedian);
+
+	//value at rank (q * count), q from 0 to 1; 0.5 is median; T() for NaN
+	template<typename bufferT> T quantile(const bufferT &buffer, double q);
+
+private:
+	//values of buffer in insert order, from both parts of ring
+	struct view {
+		const T *first;
+		unsigned long firstLen;
+		const T *second;
+		unsigned long secondLen;
+
+		unsigned long len() const { return firstLen + secondLen; }
+		T at(unsigned long i) const { return i < firstLen ? first[i] : second[i - firstLen]; }
+
+		//calls scan(arr, len) for contiguous parts of entries [from, to)
+		template<typename scanT> void parts(unsigned long from, unsigned long to, const scanT &scan) const {
+			if (from < firstLen) scan(first + from, (to < firstLen ? to : firstLen) - from);
+			if (to > firstLen) scan(second + (from > firstLen ? from - firstLen : 0), to - (from > firstLen ? from : firstLen));
+		}
+	};
+
+	static const unsigned long sampleSize = 16384;
+	static const unsigned long sampleMargin = 256; //2 * sqrt(sampleSize), k-th of all is between bounds almost always
+	static const unsigned sampleAttempts = 3;
+
+	qthreadpool &_pool;
+	std::mt19937_64 _random; //sample positions
+
+	template<typename bufferT> static view viewOf(const bufferT &buffer);
+	unsigned chunks() const { return _pool.getThreads() * 4; } //more chunks then threads, so uneven ones even out
+	static unsigned long chunkStart(unsigned long len, unsigned chunk, unsigned chunks) { return (unsigned long)((unsigned long long)len * chunk / chunks); }
+
+	T selectRank(const view &values, unsigned long k);
+	static T selectAll(const view &values, unsigned long k);
+};
+
+template<typename T, typename resultingT>
+template<typename bufferT>
+typename qparallelselect<T, resultingT>::view qparallelselect<T, resultingT>::viewOf(const bufferT &buffer) {
+	const T *first, *second;
+	decltype(buffer.getCount()) firstLen, secondLen;
+	buffer.spans(first, firstLen, second, secondLen);
+	return view{ first, firstLen, second, secondLen };
+}
+
+template<typename T, typename resultingT>
+template<typename bufferT>
+T qparallelselect<T, resultingT>::median(const bufferT &buffer) {
+	view values = viewOf(buffer);
+	if (values.len() == 0) return T();
+	return selectRank(values, values.len() / 2);
+}
+
+template<typename T, typename resultingT>
+template<typename bufferT>
+T qparallelselect<T, resultingT>::quantile(const bufferT &buffer, double q) {
+	view values = viewOf(buffer);
+	unsigned long len = values.len();
+	if (len == 0 || q != q) return T(); //NaN has no rank (and converting it is undefined)
+	unsigned long k = q <= 0 ? 0 : q >= 1 ? len - 1 : (unsigned long)(q * (double)len);
+	return selectRank(values, k < len ? k : len - 1);
+}
+
+template<typename T, typename resultingT>
+template<typename bufferT>
+resultingT qparallelselect<T, resultingT>::medianAverage(const bufferT &buffer) {
+	return medianAverage(buffer, buffer.getCount() / 4);
+}
+
+//band [first, last] of ranks is: copies of first value, all values strictly between first and last, and copies of last value
+template<typename T, typename resultingT>
+template<typename bufferT>
+resultingT qparallelselect<T, resultingT>::medianAverage(const bufferT &buffer, unsigned long maxDistanceFromMedian) {
+	view values = viewOf(buffer);
+	unsigned long len = values.len();
+	if (len == 0) return resultingT();
+
+	unsigned long startpos, total;
+	qmedianband<unsigned long>(len, maxDistanceFromMedian, startpos, total);
+	unsigned long firstRank = startpos;
+	unsigned long lastRank = startpos + total - 1;
+	T firstValue = selectRank(values, firstRank);
+	if (total == 1) return (resultingT)firstValue;
+	T lastValue = selectRank(values, lastRank);
+	if (!(firstValue < lastValue)) return (resultingT)firstValue;
+
+	struct part {
+		unsigned long upToFirst; //count of values not greater then first value
+		unsigned long between;
+		qrunningsum<T, unsigned long> sum; //of values between
+	};
+	unsigned tasks = chunks();
+	std::vector<part> parts(tasks);
+	_pool.run(tasks, [&](unsigned t) {
+		part &p = parts[t];
+		values.parts(chunkStart(len, t, tasks), chunkStart(len, t + 1, tasks), [&](const T *arr, unsigned long n) {
+			for (unsigned long i = 0; i < n; i++){
+				T value = arr[i];
+				if (!(firstValue < value)){
+					p.upToFirst++;
+				}
+				else if (value < lastValue){
+					p.between++;
+					p.sum.add(value);
+				}
+			}
+		});
+	});
+
+	qrunningsum<T, unsigned long> sum;
+	unsigned long upToFirst = 0, between = 0;
+	for (unsigned t = 0; t < tasks; t++){
+		upToFirst += parts[t].upToFirst;
+		between += parts[t].between;
+		sum.merge(parts[t].sum);
+	}
+	sum.addRepeated(firstValue, upToFirst - firstRank);
+	sum.addRepeated(lastValue, lastRank + 1 - (upToFirst + between));
+	return sum.template average<resultingT>(total);
+}
+
+//k-th smallest value; bounds from sample, one parallel pass to count values below and at bounds, and pick values between them
+template<typename T, typename resultingT>
+T qparallelselect<T, resultingT>::selectRank(const view &values, unsigned long k) {
+	unsigned long len = values.len();
+	if (len < QMEDIANBUFFER_PARALLEL_MIN) return selectAll(values, k);
+
+	struct part {
+		unsigned long below; //values less then low bound
+		unsigned long atLow;
+		unsigned long atHigh;
+		std::vector<T> between; //values strictly between bounds
+	};
+	unsigned tasks = chunks();
+	std::vector<T> sample(sampleSize);
+	for (unsigned attempt = 0; attempt < sampleAttempts; attempt++){
+		//random positions, so periodic or sorted runs of values do not bias the sample
+		std::uniform_int_distribution<unsigned long> position(0, len - 1);
+		for (unsigned long j = 0; j < sampleSize; j++) sample[j] = values.at(position(_random));
+		std::sort(sample.begin(), sample.end());
+		unsigned long p = (unsigned long)((unsigned long long)k * sampleSize / len);
+		bool hasLow = p >= sampleMargin;
+		bool hasHigh = p + sampleMargin < sampleSize;
+		T low = hasLow ? sample[p - sampleMargin] : T();
+		T high = hasHigh ? sample[p + sampleMargin] : T();
+
+		std::vector<part> parts(tasks);
+		_pool.run(tasks, [&](unsigned t) {
+			part &pt = parts[t];
+			pt.below = pt.atLow = pt.atHigh = 0;
+			values.parts(chunkStart(len, t, tasks), chunkStart(len, t + 1, tasks), [&](const T *arr, unsigned long n) {
+				for (unsigned long i = 0; i < n; i++){
+					T value = arr[i];
+					if (hasLow && value < low){
+						pt.below++;
+					}
+					else if (hasLow && !(low < value)){
+						pt.atLow++; //equal to low (and to high, if bounds are equal)
+					}
+					else if (hasHigh && high < value){
+						continue;
+					}
+					else if (hasHigh && !(value < high)){
+						pt.atHigh++;
+					}
+					else{
+						pt.between.push_back(value);
+					}
+				}
+			});
+		});
+
+		unsigned long below = 0, atLow = 0, between = 0, atHigh = 0;
+		for (unsigned t = 0; t < tasks; t++){
+			below += parts[t].below;
+			atLow += parts[t].atLow;
+			between += parts[t].between.size();
+			atHigh += parts[t].atHigh;
+		}
+		if (k < below) continue; //unlucky sample
+		if (k < below + atLow) return low;
+		if (k >= below + atLow + between){
+			if (k < below + atLow + between + atHigh) return high;
+			continue; //unlucky sample
+		}
+
+		std::vector<T> candidates;
+		candidates.reserve(between);
+		for (unsigned t = 0; t < tasks; t++){
+			candidates.insert(candidates.end(), parts[t].between.begin(), parts[t].between.end());
+		}
+		unsigned long rank = k - below - atLow;
+		std::nth_element(candidates.begin(), candidates.begin() + rank, candidates.end());
+		return candidates[rank];
+	}
+	return selectAll(values, k);
+}
+
+//copy of all values, selected in one thread
+template<typename T, typename resultingT>
+T qparallelselect<T, resultingT>::selectAll(const view &values, unsigned long k) {
+	std::vector<T> all(values.first, values.first + values.firstLen);
+	all.insert(all.end(), values.second, values.second + values.secondLen);
+	std::nth_element(all.begin(), all.begin() + k, all.end());
+	return all[k];
+}
+#endif
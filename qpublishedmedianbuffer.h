@@ -0,0 +1,195 @@
+/* Window with statistics recomputed by a background thread, and published for near-zero cost reads.
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   control loop needs the latest median, medianAverage or rate at any moment, and cannot afford
+   to select values in line, nor to wait for anybody that does.
+
+   Implementation:
+   -samples are pushed through qspscmedianbuffer, so push() is wait-free (one slot written between an acquire load
+   and a release store, no lock, so it may be called from a signal handler); it never wakes the worker, worker polls for samples:
+   with period 0 it sleeps QMEDIANBUFFER_PUBLISH_IDLE_POLL_US between checks only while there are none
+   -worker thread takes all samples pushed since last time, recomputes chosen statistics once
+   (coalesced: many pushes, one recompute), at most once per period (rate-limited; period 0 is as soon as possible),
+   and publishes them under seqlock; results are atomics, so read() is a few loads, with no lock,
+   and never waits for the worker to finish computing
+   -which statistics are recomputed is chosen with QMEDIANBUFFER_PUBLISH_... bits
+
+   Note on values:
+   -needs C++11 <atomic> and <thread>; <T>, <resultingT> and <sizeT> should be lock-free atomics
+   -read() gives version 0 until the first results are published
+   -samples that find transfer ring full are dropped (see getDroppedCount()); ring should hold all samples pushed
+   during one period plus one recompute (default holds 16 * capacity, at least 16384, so about 80 us of pushes at 5 ns each,
+   while worker sleeps one idle poll and recomputes)
+   */
+
+#ifndef qpublishedmedianbuffer_h
+#define qpublishedmedianbuffer_h
+#include "qspscmedianbuffer.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+//statistics recomputed by worker (bits can be or-ed)
+#define QMEDIANBUFFER_PUBLISH_MEDIAN 0x01	//median()
+#define QMEDIANBUFFER_PUBLISH_MEDIANAVERAGE 0x02	//medianAverage()
+#define QMEDIANBUFFER_PUBLISH_AVERAGE 0x04	//average()
+#define QMEDIANBUFFER_PUBLISH_MINMAX 0x08	//minValue(), maxValue()
+#define QMEDIANBUFFER_PUBLISH_RATES 0x10	//medianRateOfChange(), averageRateOfChange()
+#define QMEDIANBUFFER_PUBLISH_ALL 0x1F
+
+//worker with period 0 checks for new samples this often while there are none (latency of first result after a pause)
+#define QMEDIANBUFFER_PUBLISH_IDLE_POLL_US 50
+
+//<T>, <timeT>, <resultingT>, <indexT>, <sizeT> as with qmedianbuffer (worker window is qmedianbuffer of them)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT = qnoindex, typename sizeT = uint8_t>
+class qpublishedmedianbuffer
+{
+public:
+	//last published statistics; those not chosen are left at zero
+	struct results {
+		unsigned long version;	//count of publications, 0 if none yet
+		sizeT count;
+		T median;
+		resultingT medianAverage;
+		resultingT average;
+		T minValue;
+		T maxValue;
+		resultingT medianRateOfChange;
+		resultingT averageRateOfChange;
+	};
+
+	//window of capacity entries; publish is QMEDIANBUFFER_PUBLISH_... bits, period is min time between recomputes;
+	//queueCapacity is size of transfer ring: samples pushed in one period plus one recompute must fit, or they are dropped;
+	//0 takes 16 * capacity, at least 16384 (bursts of more samples between recomputes need bigger ring); options as with qmedianbuffer
+	qpublishedmedianbuffer(sizeT capacity, uint8_t publish, std::chrono::microseconds period = std::chrono::microseconds(0), unsigned long queueCapacity = 0, uint8_t options = 0);
+	~qpublishedmedianbuffer();
+
+	//producer side: wait-free, never blocks and never wakes worker; returns false if transfer ring is full, and sample is dropped
+	bool push(T number, timeT currentTime);
+	unsigned long getDroppedCount() { return _ingest.getDroppedCount(); }
+
+	//any thread: consistent copy of last published statistics
+	results read() const;
+
+private:
+	qspscmedianbuffer<T, timeT, resultingT, indexT, sizeT> _ingest;
+	uint8_t _publish{};
+	std::chrono::microseconds _period{};
+
+	//published results, written only by worker, under seqlock
+	char _padBefore[QMEDIANBUFFER_CACHE_LINE];
+	std::atomic<unsigned long> _sequence{ 0 };
+	std::atomic<sizeT> _count{};
+	std::atomic<T> _median{};
+	std::atomic<resultingT> _medianAverage{};
+	std::atomic<resultingT> _average{};
+	std::atomic<T> _minValue{};
+	std::atomic<T> _maxValue{};
+	std::atomic<resultingT> _medianRateOfChange{};
+	std::atomic<resultingT> _averageRateOfChange{};
+	char _padAfter[QMEDIANBUFFER_CACHE_LINE];
+
+	std::atomic<bool> _running{ true };
+	std::thread _worker;
+
+	void work();
+	void recompute();
+};
+
+//------------------------------------------------------------------------------------
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+qpublishedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::qpublishedmedianbuffer(sizeT capacity, uint8_t publish, std::chrono::microseconds period, unsigned long queueCapacity, uint8_t options)
+	: _ingest(capacity, queueCapacity ? queueCapacity : (16UL * capacity > 16384 ? 16UL * capacity : 16384), options), _publish(publish), _period(period) {
+	_worker = std::thread(&qpublishedmedianbuffer::work, this); //all members are ready by now
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+qpublishedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::~qpublishedmedianbuffer() {
+	_running.store(false); //worker sees it after its current sleep (period or idle poll)
+	_worker.join();
+}
+
+//only into transfer ring; worker finds samples on its own
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+bool qpublishedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::push(T number, timeT currentTime) {
+	return _ingest.push(number, currentTime);
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+typename qpublishedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::results qpublishedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::read() const {
+	results r;
+	for (;;){
+		unsigned long before = _sequence.load(std::memory_order_acquire);
+		if (before & 1) continue; //worker is in the middle of publishing
+
+		r.count = _count.load(std::memory_order_relaxed);
+		r.median = _median.load(std::memory_order_relaxed);
+		r.medianAverage = _medianAverage.load(std::memory_order_relaxed);
+		r.average = _average.load(std::memory_order_relaxed);
+		r.minValue = _minValue.load(std::memory_order_relaxed);
+		r.maxValue = _maxValue.load(std::memory_order_relaxed);
+		r.medianRateOfChange = _medianRateOfChange.load(std::memory_order_relaxed);
+		r.averageRateOfChange = _averageRateOfChange.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire); //all results are read before counter is checked again
+		if (_sequence.load(std::memory_order_relaxed) == before){
+			r.version = before / 2;
+			return r;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------
+//worker
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qpublishedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::work() {
+	const std::chrono::microseconds idlePoll(QMEDIANBUFFER_PUBLISH_IDLE_POLL_US);
+	while (_running.load()){
+		if (_ingest.getPendingCount() > 0){
+			recompute();
+			if (_period.count() > 0) std::this_thread::sleep_for(_period);
+			continue;
+		}
+		//nothing pending: wait a period, or with period 0 poll again shortly (push never wakes worker)
+		std::this_thread::sleep_for(_period.count() > 0 ? _period : idlePoll);
+	}
+}
+
+//all pending samples are taken at once, so statistics are computed once for all of them
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qpublishedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::recompute() {
+	const qmedianbuffer<T, timeT, resultingT, indexT, sizeT> &window = _ingest.window();
+
+	sizeT count = window.getCount();
+	T median{}, minValue{}, maxValue{};
+	resultingT medianAverage{}, average{}, medianRate{}, averageRate{};
+	if (_publish & QMEDIANBUFFER_PUBLISH_MEDIAN) median = window.median();
+	if (_publish & QMEDIANBUFFER_PUBLISH_MEDIANAVERAGE) medianAverage = window.medianAverage();
+	if (_publish & QMEDIANBUFFER_PUBLISH_AVERAGE) average = window.average();
+	if (_publish & QMEDIANBUFFER_PUBLISH_MINMAX){
+		minValue = window.minValue();
+		maxValue = window.maxValue();
+	}
+	if (_publish & QMEDIANBUFFER_PUBLISH_RATES){
+		medianRate = window.medianRateOfChange();
+		averageRate = window.averageRateOfChange();
+	}
+
+	//results are computed before publishing starts, so readers retry only for a few stores
+	unsigned long sequence = _sequence.load(std::memory_order_relaxed);
+	_sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release); //odd counter is seen before any changed result
+	_count.store(count, std::memory_order_relaxed);
+	_median.store(median, std::memory_order_relaxed);
+	_medianAverage.store(medianAverage, std::memory_order_relaxed);
+	_average.store(average, std::memory_order_relaxed);
+	_minValue.store(minValue, std::memory_order_relaxed);
+	_maxValue.store(maxValue, std::memory_order_relaxed);
+	_medianRateOfChange.store(medianRate, std::memory_order_relaxed);
+	_averageRateOfChange.store(averageRate, std::memory_order_relaxed);
+	_sequence.store(sequence + 2, std::memory_order_release);
+}
+#endif
@@ -0,0 +1,220 @@
+/* Window filled by many threads, each into its own shard, merged on query.
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   many threads (or cores) record samples into one logical window (e.g. latencies),
+   and one shared, locked qmedianbuffer would serialize all of them.
+
+   Implementation:
+   -each writer thread pushes only into its own shard: a ring guarded by its own sequence counter (seqlock),
+   so push() is O(1), takes no lock, and shares no written memory with other writers
+   -shards are padded and their rings allocated with spare slots around them, so no two shards
+   (and no shard and the reader) write to the same cache line
+   -window() copies each shard (retrying a shard if its writer changed it meanwhile), merges them by time
+   from newest end (k-way, heap of shards, O(capacity * log shards)) and keeps the newest <capacity> entries
+   in a qmedianbuffer only the reader touches;
+   median, average, min/max and all other statistics are then read from it, exact as with one buffer
+
+   Note on values:
+   -needs C++11 <atomic>; <T> and <timeT> should be lock-free atomics (integers, float, double)
+   -all shards must be pushed with times of one shared clock, and times should not decrease within a shard;
+   entries with equal time in different shards are taken in any order
+   -times are merged by their age from newest time of all shards, (timeT)(newest - time), so <timeT> may wrap;
+   newest entries of the shards should be less then half range of <timeT> apart, and all entries less then its range
+   -each shard holds <capacity> entries, so newest <capacity> entries of all shards are always there
+   -window() is for one reader thread at a time; memory is (shards + 2) * capacity * (<T> + <timeT>) + shards * (<sizeT> + 2)
+   */
+
+#ifndef qshardedmedianbuffer_h
+#define qshardedmedianbuffer_h
+#include "qmedianbuffer.h"
+#include <atomic>
+
+//<T>, <timeT>, <resultingT>, <indexT>, <sizeT> as with qmedianbuffer (merged window is qmedianbuffer of them)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT = qnoindex, typename sizeT = uint8_t>
+class qshardedmedianbuffer
+{
+public:
+	typedef qmedianbuffer<T, timeT, resultingT, indexT, sizeT> windowT;
+
+	//window of capacity entries, fed by shards writers (e.g. one per thread or core)
+	qshardedmedianbuffer(sizeT capacity, uint16_t shards, uint8_t options = 0);
+	~qshardedmedianbuffer();
+
+	//writer side: each shard is pushed to by one thread only
+	void push(uint16_t shard, T number, timeT currentTime);
+	uint16_t getShards() { return _shards; }
+	sizeT getCapacity() { return _capacity; }
+
+	//reader side: merges newest entries of all shards, and returns window for statistics
+	windowT &window();
+
+private:
+	struct entry {
+		std::atomic<T> value;
+		std::atomic<timeT> time;
+	};
+
+	//padding keeps written fields of neighbouring shards on different cache lines
+	struct shard {
+		char _padBefore[QMEDIANBUFFER_CACHE_LINE];
+		std::atomic<unsigned long> sequence; //even: ring is consistent; odd: writer is changing it
+		std::atomic<sizeT> head;
+		std::atomic<sizeT> count;
+		entry *ring;
+		char _padAfter[QMEDIANBUFFER_CACHE_LINE];
+	};
+
+	static const unsigned long ringPad = QMEDIANBUFFER_CACHE_LINE / sizeof(entry) + 1;
+
+	shard *shards = nullptr;
+	entry *rings = nullptr;
+	uint16_t _shards{};
+	sizeT _capacity{};
+
+	//reader side: copies of shards, and merged entries
+	T *copiedValues = nullptr;
+	timeT *copiedTimes = nullptr;
+	sizeT *copiedCounts = nullptr;
+	uint16_t *heap = nullptr;	//shards with entries left to merge, the one with newest next entry on top
+	T *mergedValues = nullptr;
+	timeT *mergedTimes = nullptr;
+	windowT _window;
+
+	void copyShard(uint16_t i);
+	timeT nextAge(uint16_t i, timeT newest) const;
+	void siftDown(uint16_t len, uint16_t pos, timeT newest);
+};
+
+//------------------------------------------------------------------------------------
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::qshardedmedianbuffer(sizeT capacity, uint16_t shardCount, uint8_t options) : _shards(shardCount), _capacity(capacity), _window(capacity, options) {
+	unsigned long stride = (unsigned long)capacity + ringPad;
+	shards = new shard[shardCount];
+	rings = new entry[(unsigned long)shardCount * stride + ringPad];
+	for (uint16_t i = 0; i < shardCount; i++){
+		shards[i].sequence.store(0, std::memory_order_relaxed);
+		shards[i].head.store(0, std::memory_order_relaxed);
+		shards[i].count.store(0, std::memory_order_relaxed);
+		shards[i].ring = rings + ringPad + (unsigned long)i * stride;
+	}
+
+	copiedValues = new T[(unsigned long)shardCount * capacity];
+	copiedTimes = new timeT[(unsigned long)shardCount * capacity];
+	copiedCounts = new sizeT[shardCount];
+	heap = new uint16_t[shardCount];
+	mergedValues = new T[capacity];
+	mergedTimes = new timeT[capacity];
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::~qshardedmedianbuffer() {
+	delete[] shards;
+	delete[] rings;
+	delete[] copiedValues;
+	delete[] copiedTimes;
+	delete[] copiedCounts;
+	delete[] heap;
+	delete[] mergedValues;
+	delete[] mergedTimes;
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::push(uint16_t i, T number, timeT currentTime) {
+	shard &s = shards[i];
+	unsigned long sequence = s.sequence.load(std::memory_order_relaxed);
+	sizeT head = s.head.load(std::memory_order_relaxed);
+	sizeT count = s.count.load(std::memory_order_relaxed);
+
+	s.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release); //odd counter is seen before changed entry
+	s.ring[head].value.store(number, std::memory_order_relaxed);
+	s.ring[head].time.store(currentTime, std::memory_order_relaxed);
+	s.head.store(head + 1 == _capacity ? 0 : head + 1, std::memory_order_relaxed);
+	if (count < _capacity) s.count.store(count + 1, std::memory_order_relaxed);
+	s.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+//copies shard i oldest first to its part of copied arrays
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::copyShard(uint16_t i) {
+	shard &s = shards[i];
+	T *values = copiedValues + (unsigned long)i * _capacity;
+	timeT *times = copiedTimes + (unsigned long)i * _capacity;
+	for (;;){
+		unsigned long before = s.sequence.load(std::memory_order_acquire);
+		if (before & 1) continue; //writer is in the middle of push
+
+		sizeT head = s.head.load(std::memory_order_relaxed);
+		sizeT count = s.count.load(std::memory_order_relaxed);
+		sizeT pos = head >= count ? head - count : head + _capacity - count; //oldest entry
+		for (sizeT j = 0; j < count; j++){
+			values[j] = s.ring[pos].value.load(std::memory_order_relaxed);
+			times[j] = s.ring[pos].time.load(std::memory_order_relaxed);
+			pos = pos + 1 == _capacity ? 0 : pos + 1;
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire); //all entries are read before counter is checked again
+		if (s.sequence.load(std::memory_order_relaxed) == before){
+			copiedCounts[i] = count;
+			return;
+		}
+	}
+}
+
+//age of newest entry of shard i not merged yet, from newest time of all shards (does not wrap)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+timeT qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::nextAge(uint16_t i, timeT newest) const {
+	return (timeT)(newest - copiedTimes[(unsigned long)i * _capacity + copiedCounts[i] - 1]);
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::siftDown(uint16_t len, uint16_t pos, timeT newest) {
+	for (;;){
+		unsigned long child = 2 * (unsigned long)pos + 1;
+		if (child >= len) return;
+		if (child + 1 < len && nextAge(heap[child + 1], newest) < nextAge(heap[child], newest)) child++;
+		if (!(nextAge(heap[child], newest) < nextAge(heap[pos], newest))) return;
+		uint16_t swapped = heap[pos];
+		heap[pos] = heap[child];
+		heap[child] = swapped;
+		pos = (uint16_t)child;
+	}
+}
+
+//merges from newest end of each shard, until window is full or shards are exhausted
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+typename qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::windowT &qshardedmedianbuffer<T, timeT, resultingT, indexT, sizeT>::window() {
+	for (uint16_t i = 0; i < _shards; i++) copyShard(i);
+
+	//newest time of all shards is reference of ages; time less then half range ahead of it is newer
+	const timeT halfRange = (timeT)(~timeT()) / 2;
+	timeT newest{};
+	uint16_t len = 0;
+	for (uint16_t i = 0; i < _shards; i++){
+		if (copiedCounts[i] == 0) continue;
+		timeT t = copiedTimes[(unsigned long)i * _capacity + copiedCounts[i] - 1];
+		timeT ahead = (timeT)(t - newest);
+		if (len == 0 || (ahead != 0 && ahead <= halfRange)) newest = t;
+		heap[len++] = i;
+	}
+	for (uint16_t pos = len / 2; pos-- > 0;) siftDown(len, pos, newest);
+
+	sizeT merged = _capacity;
+	while (merged > 0 && len > 0){
+		uint16_t i = heap[0];
+		merged--;
+		copiedCounts[i]--;
+		unsigned long at = (unsigned long)i * _capacity + copiedCounts[i];
+		mergedValues[merged] = copiedValues[at];
+		mergedTimes[merged] = copiedTimes[at];
+		if (copiedCounts[i] == 0) heap[0] = heap[--len]; //shard exhausted
+		siftDown(len, 0, newest);
+	}
+
+	_window.clear();
+	_window.pushMany(mergedValues + merged, mergedTimes + merged, (unsigned long)(_capacity - merged));
+	return _window;
+}
+#endif
@@ -0,0 +1,525 @@
+/* Approximate median and quantiles of a whole stream, in fixed memory (KLL sketch).
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   streams of millions of samples, where keeping them all for exact median costs too much,
+   and small error of rank is fine (e.g. 1%); sketches of many sources can be merged, or sent as bytes.
+
+   Implementation:
+   -values are kept in levels; value at level h stands for 2^h values of stream (weights of all retained
+   values always sum up to count)
+   -when sketch is full, lowest level that is over its capacity is sorted, and every other value of it
+   (odd or even ones, by chance) goes one level up, so half of them are dropped;
+   capacity of level is <k> at top, and 2/3 of that for each level below (but at least 8)
+   -all levels live in one array allocated once: level 0 grows towards its start,
+   levels above it are kept sorted, so queries walk them in order, merging them on the way
+   -count, min, max and average are exact (average from qrunningsum); median, quantile, rank and
+   medianAverage are approximate, with rank error of about 1.7 / <k> (e.g. 0.85% for k = 200)
+
+   Note on values:
+   -memory is fixed by <k>: about (3 * <k> + 8 * bits of unsigned long) * <T>, no matter how long stream is
+   -<k> is at most 16000
+   -serialized sketch is in native byte order and type sizes, so it is read back by the same build of it;
+   its size is about (retained values * <T>) + 70 bytes
+   -with big numbers, see note on <resultingT> in qmedianbuffer.h
+   */
+
+#ifndef qsketchmedianbuffer_h
+#define qsketchmedianbuffer_h
+#include "qmedianbuffer.h"
+#if !defined(ARDUINO)
+#include <cstring>
+#endif
+
+//<T> numeric data, <timeT> strictly UNSIGNED type for time, <resultingT> return type of math heavy functions (as with qmedianbuffer)
+template<typename T, typename timeT, typename resultingT>
+class qsketchmedianbuffer
+{
+public:
+	//k sets accuracy (rank error about 1.7 / k) and memory; seed of choice which half goes up
+	qsketchmedianbuffer(uint16_t k = 200, uint32_t seed = 0x9E3779B9);
+	~qsketchmedianbuffer() {
+		delete[] items;
+	}
+
+	void push(T number, timeT currentTime);
+	void clear();
+	//adds all values of other sketch (of any k, or this one), as if they were pushed here
+	void merge(const qsketchmedianbuffer &other);
+
+	bool isEmpty() const { return _count == 0; }
+	unsigned long getCount() const { return _count; }
+	uint16_t getRetained() const { return _allocated - levels[0]; }
+
+	//exact
+	T minValue() const { return _minValue; }
+	T maxValue() const { return _maxValue; }
+	resultingT average() const;
+	resultingT averageInterval() const;
+	resultingT averageRateOfChange() const;
+
+	//approximate
+	T median() const;
+	T quantile(double q) const;	//value at rank (q * count), q from 0 to 1
+	resultingT rank(T value) const;	//part of values not greater then value, 0 to 1
+	resultingT medianAverage() const;
+	resultingT medianAverage(unsigned long maxDistanceFromMedian) const;
+
+	//compact copy of sketch; serialize() writes serializedSize() bytes and returns their count
+	unsigned long serializedSize() const;
+	unsigned long serialize(uint8_t *out) const;
+	//reads serialized sketch of the same <k> (and types) back; false if bytes do not fit, or their weights do not sum up to count
+	bool deserialize(const uint8_t *in, unsigned long len);
+
+private:
+	static const uint8_t maxLevels = 8 * sizeof(unsigned long); //count overflows before more levels are needed
+	static const uint16_t minCapacity = 8;
+	static const uint8_t formatVersion = 2;
+
+	T *items = nullptr;
+	uint16_t levels[maxLevels + 1]; //level h is items[levels[h] .. levels[h + 1]); levels[numLevels] is end of array
+	uint8_t _numLevels{};
+	uint16_t _k{};
+	uint16_t _allocated{};
+	uint16_t _capacityOfLevels{}; //capacity of all current levels; sketch is full at it
+	uint32_t _random{};
+
+	unsigned long _count{};
+	T _minValue{};
+	T _maxValue{};
+	timeT _lastTime{};
+	unsigned long _intervals{};	//count of intervals summed (merged sketches bring their own, with no interval between them)
+	qintervalsum<timeT, unsigned long> _intervalSum;	//of intervals between pushes, so lifetime of stream may wrap
+	qrunningsum<T, unsigned long> _sum;
+
+	uint16_t levelCapacity(uint8_t depth) const;
+	uint16_t capacityOf(uint8_t numLevels) const;
+	void addTopLevel();
+	void compress();
+	void mergeSelf();
+	void insert(T value, uint8_t level);
+	bool randomBit();
+
+	void take(T number, timeT currentTime);
+	template<typename visitT> void walk(const visitT &visit) const;
+	static void sortValues(T *arr, uint16_t len);
+};
+
+//------------------------------------------------------------------------------------
+
+template<typename T, typename timeT, typename resultingT>
+qsketchmedianbuffer<T, timeT, resultingT>::qsketchmedianbuffer(uint16_t k, uint32_t seed) {
+	_k = k < minCapacity ? minCapacity : (k > 16000 ? 16000 : k);
+	_random = seed ? seed : 1;
+	_allocated = capacityOf(maxLevels); //the most all levels can ever hold
+	items = new T[_allocated];
+	clear();
+}
+
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::clear() {
+	_numLevels = 1;
+	levels[0] = levels[1] = _allocated;
+	_capacityOfLevels = capacityOf(1);
+	_count = 0;
+	_minValue = _maxValue = T();
+	_lastTime = timeT();
+	_intervals = 0;
+	_intervalSum.clear();
+	_sum.clear();
+}
+
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::push(T number, timeT currentTime) {
+	take(number, currentTime);
+	insert(number, 0);
+}
+
+//exact statistics of pushed value
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::take(T number, timeT currentTime) {
+	if (_count == 0){
+		_minValue = _maxValue = number;
+	}
+	else{
+		_intervalSum.addBetween(_lastTime, currentTime);
+		_intervals++;
+	}
+	if (number < _minValue) _minValue = number;
+	if (number > _maxValue) _maxValue = number;
+	_lastTime = currentTime;
+	_sum.add(number);
+	_count++;
+}
+
+//values of other sketch go to the same levels here (so they keep their weight), exact statistics are joined
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::merge(const qsketchmedianbuffer &other) {
+	if (other._count == 0) return;
+	if (&other == this){
+		mergeSelf();
+		return;
+	}
+	if (_count == 0){
+		_minValue = other._minValue;
+		_maxValue = other._maxValue;
+		_lastTime = other._lastTime;
+	}
+	if (other._minValue < _minValue) _minValue = other._minValue;
+	if (other._maxValue > _maxValue) _maxValue = other._maxValue;
+	_intervalSum.merge(other._intervalSum);
+	_intervals += other._intervals;
+	_sum.merge(other._sum);
+	_count += other._count;
+
+	for (uint8_t h = 0; h < other._numLevels; h++){
+		for (uint16_t i = other.levels[h]; i < other.levels[h + 1]; i++){
+			insert(other.items[i], h);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------
+//levels
+
+//capacity of level at depth from top: k * (2/3)^depth, but at least minCapacity
+template<typename T, typename timeT, typename resultingT>
+uint16_t qsketchmedianbuffer<T, timeT, resultingT>::levelCapacity(uint8_t depth) const {
+	uint32_t capacity = _k;
+	for (uint8_t i = 0; i < depth && capacity > minCapacity; i++){
+		capacity = (2 * capacity + 2) / 3;
+	}
+	return capacity < minCapacity ? minCapacity : (uint16_t)capacity;
+}
+
+template<typename T, typename timeT, typename resultingT>
+uint16_t qsketchmedianbuffer<T, timeT, resultingT>::capacityOf(uint8_t numLevels) const {
+	uint32_t total = 0;
+	for (uint8_t depth = 0; depth < numLevels; depth++) total += levelCapacity(depth);
+	return (uint16_t)total;
+}
+
+//new empty level on top (at the end of array)
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::addTopLevel() {
+	levels[_numLevels + 1] = levels[_numLevels];
+	_numLevels++;
+	_capacityOfLevels = capacityOf(_numLevels);
+}
+
+//xorshift; only decides which half of compacted level goes up
+template<typename T, typename timeT, typename resultingT>
+bool qsketchmedianbuffer<T, timeT, resultingT>::randomBit() {
+	_random ^= _random << 13;
+	_random ^= _random >> 17;
+	_random ^= _random << 5;
+	return (_random >> 31) != 0;
+}
+
+/*
+lowest level over its capacity is halved: sorted (level 0 only, others are sorted already), and every
+other value of it is merged into level above; with odd count, first value of level is set aside and stays
+(the smallest one on sorted levels; on level 0 it is the newest one, as it is not sorted yet).
+Levels below it move up to fill the gap, so free space stays at the start of array.
+*/
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::compress() {
+	uint8_t h = 0;
+	while (h + 1 < _numLevels && (uint16_t)(levels[h + 1] - levels[h]) < levelCapacity(_numLevels - 1 - h)) h++;
+	if (h + 1 == _numLevels) addTopLevel();
+
+	uint16_t rawBegin = levels[h];
+	uint16_t rawEnd = levels[h + 1];
+	uint16_t countAbove = levels[h + 2] - rawEnd;
+	uint16_t odd = (rawEnd - rawBegin) & 1;
+	uint16_t begin = rawBegin + odd;
+	uint16_t count = rawEnd - begin;
+	uint16_t half = count / 2;
+
+	if (h == 0) sortValues(items + begin, count);
+	uint16_t from = begin + (randomBit() ? 1 : 0);
+	if (countAbove == 0){
+		//level above is empty, chosen half goes to upper part of this level (from the end down)
+		for (uint16_t i = 0; i < half; i++) items[rawEnd - 1 - i] = items[from + count - 2 - 2 * i];
+	}
+	else{
+		//chosen half to lower part, then merged with level above into place just before its end;
+		//writing never passes values not read yet
+		for (uint16_t i = 0; i < half; i++) items[begin + i] = items[from + 2 * i];
+		uint16_t a = begin, aEnd = begin + half;
+		uint16_t b = rawEnd, bEnd = rawEnd + countAbove;
+		uint16_t out = begin + half;
+		while (a < aEnd && b < bEnd) items[out++] = items[b] < items[a] ? items[b++] : items[a++];
+		while (a < aEnd) items[out++] = items[a++];
+	}
+	levels[h + 1] -= half;
+	if (odd){
+		levels[h] = levels[h + 1] - 1;
+		items[levels[h]] = items[rawBegin];
+	}
+	else{
+		levels[h] = levels[h + 1];
+	}
+
+	//levels below move up by half
+	if (h > 0){
+		for (uint16_t i = rawBegin; i > levels[0]; i--) items[i - 1 + half] = items[i - 1];
+		for (uint8_t l = 0; l < h; l++) levels[l] += half;
+	}
+}
+
+//each value twice: every value doubles its weight, so all levels go one up and new empty level 0 is added below;
+//merge() can not insert values of levels it is compacting at the same time
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::mergeSelf() {
+	if (_numLevels == maxLevels) return; //count would overflow anyway
+	qintervalsum<timeT, unsigned long> intervalSum = _intervalSum;
+	qrunningsum<T, unsigned long> sum = _sum;
+	_intervalSum.merge(intervalSum);
+	_intervals *= 2;
+	_sum.merge(sum);
+	_count *= 2;
+
+	sortValues(items + levels[0], levels[1] - levels[0]); //levels above 0 are sorted
+	for (uint8_t h = _numLevels + 1; h > 0; h--) levels[h] = levels[h - 1];
+	_numLevels++;
+	_capacityOfLevels = capacityOf(_numLevels);
+}
+
+//value of weight 2^level; level 0 is unsorted, higher levels keep their order
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::insert(T value, uint8_t level) {
+	while (_numLevels <= level) addTopLevel();
+	if ((uint16_t)(_allocated - levels[0]) >= _capacityOfLevels) compress();
+
+	//levels below move one place down, so first place of this level is free
+	for (uint16_t i = levels[0]; i < levels[level]; i++) items[i - 1] = items[i];
+	for (uint8_t l = 0; l <= level; l++) levels[l]--;
+	if (level == 0){
+		items[levels[0]] = value;
+		return;
+	}
+	uint16_t i = levels[level];
+	while (i + 1 < levels[level + 1] && items[i + 1] < value){
+		items[i] = items[i + 1];
+		i++;
+	}
+	items[i] = value;
+}
+
+//shell sort, level 0 is up to <k> values
+template<typename T, typename timeT, typename resultingT>
+void qsketchmedianbuffer<T, timeT, resultingT>::sortValues(T *arr, uint16_t len) {
+	uint16_t gap = 1;
+	while (gap < len / 3) gap = 3 * gap + 1;
+	for (; gap > 0; gap /= 3){
+		for (uint16_t i = gap; i < len; i++){
+			T value = arr[i];
+			uint16_t j = i;
+			while (j >= gap && value < arr[j - gap]){
+				arr[j] = arr[j - gap];
+				j -= gap;
+			}
+			arr[j] = value;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------
+//queries
+
+/*
+retained values are visited in ascending order, each with its weight (count of stream values it stands for):
+level 0 is sorted in a copy, and all levels are merged by taking the smallest of their heads;
+visit(value, weight) returns false to stop
+*/
+template<typename T, typename timeT, typename resultingT>
+template<typename visitT>
+void qsketchmedianbuffer<T, timeT, resultingT>::walk(const visitT &visit) const {
+	uint16_t countOfFirst = levels[1] - levels[0];
+	qscratch<T, QMEDIANBUFFER_STACK_SCRATCH> first(countOfFirst);
+	for (uint16_t i = 0; i < countOfFirst; i++) first.data()[i] = items[levels[0] + i];
+	sortValues(first.data(), countOfFirst);
+
+	uint16_t heads[maxLevels];
+	heads[0] = 0;
+	for (uint8_t h = 1; h < _numLevels; h++) heads[h] = levels[h];
+	for (;;){
+		uint8_t smallest = maxLevels;
+		T smallestValue{};
+		if (heads[0] < countOfFirst){
+			smallest = 0;
+			smallestValue = first.data()[heads[0]];
+		}
+		for (uint8_t h = 1; h < _numLevels; h++){
+			if (heads[h] < levels[h + 1] && (smallest == maxLevels || items[heads[h]] < smallestValue)){
+				smallest = h;
+				smallestValue = items[heads[h]];
+			}
+		}
+		if (smallest == maxLevels) return;
+		heads[smallest]++;
+		if (!visit(smallestValue, 1UL << smallest)) return;
+	}
+}
+
+template<typename T, typename timeT, typename resultingT>
+T qsketchmedianbuffer<T, timeT, resultingT>::median() const {
+	if (_count == 0) return T();
+	return quantile(0.5);
+}
+
+//value whose weights cover rank (q * count); min and max are exact ends
+template<typename T, typename timeT, typename resultingT>
+T qsketchmedianbuffer<T, timeT, resultingT>::quantile(double q) const {
+	if (_count == 0) return T();
+	if (q <= 0) return _minValue;
+	if (q >= 1) return _maxValue;
+
+	unsigned long target = (unsigned long)(q * (double)_count);
+
+	T found = _maxValue;
+	unsigned long seen = 0;
+	walk([&](T value, unsigned long weight) {
+		seen += weight;
+		if (seen <= target) return true;
+		found = value;
+		return false;
+	});
+	return found;
+}
+
+template<typename T, typename timeT, typename resultingT>
+resultingT qsketchmedianbuffer<T, timeT, resultingT>::rank(T value) const {
+	if (_count == 0) return resultingT();
+	unsigned long notGreater = 0;
+	walk([&](T retained, unsigned long weight) {
+		if (value < retained) return false;
+		notGreater += weight;
+		return true;
+	});
+	return (resultingT)notGreater / (resultingT)_count;
+}
+
+template<typename T, typename timeT, typename resultingT>
+resultingT qsketchmedianbuffer<T, timeT, resultingT>::medianAverage() const {
+	return medianAverage(_count / 4);
+}
+
+//average of ranks in median band (as with qmedianbuffer), each retained value for the part of its weight inside of band
+template<typename T, typename timeT, typename resultingT>
+resultingT qsketchmedianbuffer<T, timeT, resultingT>::medianAverage(unsigned long maxDistanceFromMedian) const {
+	if (_count == 0) return resultingT();
+
+	unsigned long startpos, bandCount;
+	qmedianband<unsigned long>(_count, maxDistanceFromMedian, startpos, bandCount);
+	unsigned long endpos = startpos + bandCount;
+
+	resultingT avgN{};
+	unsigned long seen = 0, inBand = 0;
+	walk([&](T value, unsigned long weight) {
+		unsigned long from = seen > startpos ? seen : startpos;
+		unsigned long to = seen + weight < endpos ? seen + weight : endpos;
+		seen += weight;
+		if (to > from){
+			inBand += to - from;
+			avgN = ((resultingT)value - avgN) * (resultingT)(to - from) / (resultingT)inBand + avgN; //running average, as in qmedianbuffer
+		}
+		return seen < endpos;
+	});
+	return avgN;
+}
+
+template<typename T, typename timeT, typename resultingT>
+resultingT qsketchmedianbuffer<T, timeT, resultingT>::average() const {
+	if (_count == 0) return resultingT();
+	return _sum.template average<resultingT>(_count);
+}
+
+//from sum of intervals between pushes (last - first time would wrap on long streams)
+template<typename T, typename timeT, typename resultingT>
+resultingT qsketchmedianbuffer<T, timeT, resultingT>::averageInterval() const {
+	return _intervalSum.template average<resultingT>(_intervals);
+}
+
+template<typename T, typename timeT, typename resultingT>
+resultingT qsketchmedianbuffer<T, timeT, resultingT>::averageRateOfChange() const {
+	return _intervalSum.template rate<resultingT>(_intervals);
+}
+
+//------------------------------------------------------------------------------------
+//serialization
+/*
+version, count of levels, k, count, min, max, last time, count and sum of intervals, running sum,
+count of values in each level, and retained values, level by level
+*/
+
+template<typename T, typename timeT, typename resultingT>
+unsigned long qsketchmedianbuffer<T, timeT, resultingT>::serializedSize() const {
+	return 2 + sizeof(uint16_t) + 2 * sizeof(unsigned long) + 2 * sizeof(T) + sizeof(timeT) + sizeof(_intervalSum) + sizeof(_sum)
+		+ _numLevels * sizeof(uint16_t) + (unsigned long)getRetained() * sizeof(T);
+}
+
+template<typename T, typename timeT, typename resultingT>
+unsigned long qsketchmedianbuffer<T, timeT, resultingT>::serialize(uint8_t *out) const {
+	uint8_t *p = out;
+	*p++ = formatVersion;
+	*p++ = _numLevels;
+	memcpy(p, &_k, sizeof(_k)); p += sizeof(_k);
+	memcpy(p, &_count, sizeof(_count)); p += sizeof(_count);
+	memcpy(p, &_minValue, sizeof(T)); p += sizeof(T);
+	memcpy(p, &_maxValue, sizeof(T)); p += sizeof(T);
+	memcpy(p, &_lastTime, sizeof(timeT)); p += sizeof(timeT);
+	memcpy(p, &_intervals, sizeof(_intervals)); p += sizeof(_intervals);
+	memcpy(p, &_intervalSum, sizeof(_intervalSum)); p += sizeof(_intervalSum);
+	memcpy(p, &_sum, sizeof(_sum)); p += sizeof(_sum);
+	for (uint8_t h = 0; h < _numLevels; h++){
+		uint16_t countOfLevel = levels[h + 1] - levels[h];
+		memcpy(p, &countOfLevel, sizeof(countOfLevel)); p += sizeof(countOfLevel);
+	}
+	memcpy(p, items + levels[0], (unsigned long)getRetained() * sizeof(T)); p += (unsigned long)getRetained() * sizeof(T);
+	return (unsigned long)(p - out);
+}
+
+template<typename T, typename timeT, typename resultingT>
+bool qsketchmedianbuffer<T, timeT, resultingT>::deserialize(const uint8_t *in, unsigned long len) {
+	unsigned long head = 2 + sizeof(uint16_t) + 2 * sizeof(unsigned long) + 2 * sizeof(T) + sizeof(timeT) + sizeof(_intervalSum) + sizeof(_sum);
+	if (len < head || in[0] != formatVersion || in[1] == 0 || in[1] > maxLevels) return false;
+	uint8_t numLevels = in[1];
+	uint16_t k;
+	memcpy(&k, in + 2, sizeof(k));
+	if (k != _k || len < head + numLevels * sizeof(uint16_t)) return false;
+
+	//weights of retained values (2^h at level h) must sum up to count
+	unsigned long count;
+	memcpy(&count, in + 2 + sizeof(k), sizeof(count));
+	uint16_t counts[maxLevels];
+	unsigned long retained = 0;
+	unsigned long weight = 0;
+	for (uint8_t h = 0; h < numLevels; h++){
+		memcpy(&counts[h], in + head + h * sizeof(uint16_t), sizeof(uint16_t));
+		if (counts[h] > (count - weight) >> h) return false;
+		weight += (unsigned long)counts[h] << h;
+		retained += counts[h];
+	}
+	if (weight != count) return false;
+	if (retained > _allocated || len != head + numLevels * sizeof(uint16_t) + retained * sizeof(T)) return false;
+
+	const uint8_t *p = in + 2 + sizeof(k);
+	memcpy(&_count, p, sizeof(_count)); p += sizeof(_count);
+	memcpy(&_minValue, p, sizeof(T)); p += sizeof(T);
+	memcpy(&_maxValue, p, sizeof(T)); p += sizeof(T);
+	memcpy(&_lastTime, p, sizeof(timeT)); p += sizeof(timeT);
+	memcpy(&_intervals, p, sizeof(_intervals)); p += sizeof(_intervals);
+	memcpy(&_intervalSum, p, sizeof(_intervalSum)); p += sizeof(_intervalSum);
+	memcpy(&_sum, p, sizeof(_sum)); p += sizeof(_sum);
+	p += numLevels * sizeof(uint16_t);
+
+	_numLevels = numLevels;
+	levels[numLevels] = _allocated;
+	for (uint8_t h = numLevels; h > 0; h--) levels[h - 1] = levels[h] - counts[h - 1];
+	_capacityOfLevels = capacityOf(numLevels);
+	memcpy(items + levels[0], p, retained * sizeof(T));
+	return true;
+}
+#endif
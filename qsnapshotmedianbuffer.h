@@ -0,0 +1,147 @@
+/* Window published under seqlock, for one writer and many reader threads.
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   several threads read statistics of the same window, while one thread keeps pushing into it,
+   without a mutex around each query.
+
+   Implementation:
+   -window entries are kept in a ring of relaxed atomics, guarded by a sequence counter (seqlock):
+   writer makes counter odd, writes one slot and moves head, and makes it even again,
+   so push() stays O(1) and never waits for readers
+   -each reader copies raw entries to plain arrays with snapshot(), retries if counter changed meanwhile,
+   and then pushes the copy to its own qmedianbuffer at once (pushMany), so read section is only the copy;
+   statistics are then computed on that copy, so any number of readers work at the same time
+   and never disturb the writer or each other
+   -snapshot() skips the copy if nothing was pushed since that reader's last snapshot
+
+   Note on values:
+   -needs C++11 <atomic>; <T> and <timeT> should be lock-free atomics (integers, float, double)
+   -reader window should have at least the capacity of this buffer (older entries are dropped otherwise)
+   -if writer pushes faster than a reader can copy the window, that reader keeps retrying
+   */
+
+#ifndef qsnapshotmedianbuffer_h
+#define qsnapshotmedianbuffer_h
+#include "qmedianbuffer.h"
+#include <atomic>
+
+//<T>, <timeT>, <resultingT>, <indexT>, <sizeT> as with qmedianbuffer (reader windows are qmedianbuffer of them)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT = qnoindex, typename sizeT = uint8_t>
+class qsnapshotmedianbuffer
+{
+public:
+	typedef qmedianbuffer<T, timeT, resultingT, indexT, sizeT> windowT;
+
+	qsnapshotmedianbuffer(sizeT capacity) : _capacity(capacity) {
+		values = new std::atomic<T>[capacity];
+		times = new std::atomic<timeT>[capacity];
+	}
+
+	~qsnapshotmedianbuffer() {
+		delete[] values;
+		delete[] times;
+	}
+
+	//writer side (one thread)
+	void push(T number, timeT currentTime);
+	void clear();
+	sizeT getCapacity() { return _capacity; }
+
+	//reader side (any number of threads, each with its own window)
+	//copies consistent window to local; version is that of local, kept by reader (0 for first call)
+	//returns version of the copy
+	unsigned long snapshot(windowT &local, unsigned long version = 0);
+	unsigned long getVersion();
+
+private:
+	std::atomic<T> *values = nullptr;
+	std::atomic<timeT> *times = nullptr;
+	sizeT _capacity{};
+
+	//written only by writer, padded away from neighbouring memory
+	char _padBefore[QMEDIANBUFFER_CACHE_LINE];
+	std::atomic<sizeT> _head{ 0 };
+	std::atomic<sizeT> _count{ 0 };
+	//even: window is consistent; odd: writer is changing it
+	std::atomic<unsigned long> _sequence{ 0 };
+	char _padAfter[QMEDIANBUFFER_CACHE_LINE];
+
+	void beginWrite();
+	void endWrite();
+};
+
+//------------------------------------------------------------------------------------
+//writer side
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qsnapshotmedianbuffer<T, timeT, resultingT, indexT, sizeT>::beginWrite() {
+	_sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release); //odd counter is seen before any changed entry
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qsnapshotmedianbuffer<T, timeT, resultingT, indexT, sizeT>::endWrite() {
+	_sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qsnapshotmedianbuffer<T, timeT, resultingT, indexT, sizeT>::push(T number, timeT currentTime) {
+	sizeT head = _head.load(std::memory_order_relaxed);
+	sizeT count = _count.load(std::memory_order_relaxed);
+
+	beginWrite();
+	values[head].store(number, std::memory_order_relaxed);
+	times[head].store(currentTime, std::memory_order_relaxed);
+	_head.store(head + 1 == _capacity ? 0 : head + 1, std::memory_order_relaxed);
+	if (count < _capacity) _count.store(count + 1, std::memory_order_relaxed);
+	endWrite();
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+void qsnapshotmedianbuffer<T, timeT, resultingT, indexT, sizeT>::clear() {
+	beginWrite();
+	_head.store(0, std::memory_order_relaxed);
+	_count.store(0, std::memory_order_relaxed);
+	endWrite();
+}
+
+//------------------------------------------------------------------------------------
+//reader side
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+unsigned long qsnapshotmedianbuffer<T, timeT, resultingT, indexT, sizeT>::getVersion() {
+	return _sequence.load(std::memory_order_acquire);
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+unsigned long qsnapshotmedianbuffer<T, timeT, resultingT, indexT, sizeT>::snapshot(windowT &local, unsigned long version) {
+	qscratch<T, QMEDIANBUFFER_STACK_SCRATCH> valueCopy(_capacity);
+	qscratch<timeT, QMEDIANBUFFER_STACK_SCRATCH> timeCopy(_capacity);
+	for (;;){
+		unsigned long before = _sequence.load(std::memory_order_acquire);
+		if (before == version) return version; //local is already current
+		if (before & 1) continue; //writer is in the middle of change
+
+		sizeT head = _head.load(std::memory_order_relaxed);
+		sizeT count = _count.load(std::memory_order_relaxed);
+		sizeT pos = head >= count ? head - count : head + _capacity - count; //oldest entry
+
+		//only raw copy inside read section, so it is short and writer seldom forces a retry
+		T *valueArr = valueCopy.data();
+		timeT *timeArr = timeCopy.data();
+		for (sizeT i = 0; i < count; i++){
+			valueArr[i] = values[pos].load(std::memory_order_relaxed);
+			timeArr[i] = times[pos].load(std::memory_order_relaxed);
+			pos = pos + 1 == _capacity ? 0 : pos + 1;
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire); //all entries are read before counter is checked again
+		if (_sequence.load(std::memory_order_relaxed) != before) continue;
+
+		local.clear();
+		local.pushMany(valueArr, timeArr, count);
+		return before;
+	}
+}
+#endif
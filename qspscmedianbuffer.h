@@ -0,0 +1,120 @@
+/* Single producer / single consumer front of qmedianbuffer, for ISR or thread ingestion.
+   Part of qmedianbuffer, released under MIT licence
+
+   Usecase:
+   samples are pushed by one thread (or interrupt handler), and statistics are read by another,
+   and the producer should never wait for the reader.
+
+   Implementation:
+   -producer side push() only writes into a transfer ring and moves its head (one atomic store);
+   it is wait-free, and never touches the window the statistics are read from.
+   If transfer ring is full (reader is late), sample is dropped and counted, not blocked on
+   -consumer side window() moves all pending samples from transfer ring to its own qmedianbuffer,
+   and returns it; all statistics are then read from that window, that only the consumer touches,
+   so they see consistent set of samples, and may freely use scratch and indexes
+   -head and tail of transfer ring are on separate cache lines, so producer and consumer
+   do not invalidate each other on each push
+
+   Note on values:
+   -needs C++11 <atomic>, with lock-free atomic <sizeT> (so on boards with it, e.g. ARM Cortex-M,
+   not on 8 bit AVR)
+   -transfer ring should hold as many samples as can come between two reads;
+   each slot is the size of (<T> + <timeT>)
+   */
+
+#ifndef qspscmedianbuffer_h
+#define qspscmedianbuffer_h
+#include "qmedianbuffer.h"
+#include <atomic>
+
+//<T>, <timeT>, <resultingT>, <indexT>, <sizeT> as with qmedianbuffer (window is qmedianbuffer of them)
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT = qnoindex, typename sizeT = uint8_t>
+class qspscmedianbuffer
+{
+public:
+	typedef qmedianbuffer<T, timeT, resultingT, indexT, sizeT> windowT;
+
+	//window of capacity entries, and transfer ring of queueCapacity samples (as much as window by default)
+	qspscmedianbuffer(sizeT capacity, unsigned long queueCapacity = 0, uint8_t options = 0) : _window(capacity, options) {
+		_slots = (queueCapacity ? queueCapacity : (unsigned long)capacity) + 1; //one slot is always empty
+		_queue = new slot[_slots];
+	}
+
+	~qspscmedianbuffer() {
+		delete[] _queue;
+	}
+
+	//producer side: wait-free; returns false if transfer ring is full, and sample is dropped
+	bool push(T number, timeT currentTime);
+	unsigned long getDroppedCount();
+
+	//consumer side: moves pending samples to window, and returns it for statistics
+	windowT &window();
+	unsigned long getPendingCount();
+
+private:
+	struct slot {
+		T value;
+		timeT time;
+	};
+
+	slot *_queue = nullptr;
+	unsigned long _slots{};
+
+	//written only by producer
+	char _padBeforeHead[QMEDIANBUFFER_CACHE_LINE];
+	std::atomic<unsigned long> _head{ 0 };
+	std::atomic<unsigned long> _dropped{ 0 };
+	//written only by consumer
+	char _padBeforeTail[QMEDIANBUFFER_CACHE_LINE];
+	std::atomic<unsigned long> _tail{ 0 };
+	windowT _window;
+
+	unsigned long nextSlot(unsigned long pos) { return pos + 1 == _slots ? 0 : pos + 1; }
+};
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+bool qspscmedianbuffer<T, timeT, resultingT, indexT, sizeT>::push(T number, timeT currentTime) {
+	unsigned long head = _head.load(std::memory_order_relaxed);
+	unsigned long next = nextSlot(head);
+	if (next == _tail.load(std::memory_order_acquire)){
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	_queue[head].value = number;
+	_queue[head].time = currentTime;
+	_head.store(next, std::memory_order_release); //slot is visible to consumer only after it is written
+	return true;
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+unsigned long qspscmedianbuffer<T, timeT, resultingT, indexT, sizeT>::getDroppedCount() {
+	return _dropped.load(std::memory_order_relaxed);
+}
+
+//samples pushed after head was read wait for next call
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+typename qspscmedianbuffer<T, timeT, resultingT, indexT, sizeT>::windowT &qspscmedianbuffer<T, timeT, resultingT, indexT, sizeT>::window() {
+	unsigned long tail = _tail.load(std::memory_order_relaxed);
+	unsigned long head = _head.load(std::memory_order_acquire);
+	if (tail == head) return _window;
+
+	//pending samples are in (at most) two contiguous parts of transfer ring
+	while (tail != head){
+		unsigned long end = head > tail ? head : _slots;
+		for (unsigned long i = tail; i < end; i++){
+			_window.push(_queue[i].value, _queue[i].time);
+		}
+		tail = end == _slots ? 0 : end;
+	}
+	_tail.store(tail, std::memory_order_release); //slots can be reused by producer only after they are read
+	return _window;
+}
+
+template<typename T, typename timeT, typename resultingT, template<typename, typename> class indexT, typename sizeT>
+unsigned long qspscmedianbuffer<T, timeT, resultingT, indexT, sizeT>::getPendingCount() {
+	unsigned long tail = _tail.load(std::memory_order_relaxed);
+	unsigned long head = _head.load(std::memory_order_acquire);
+	return head >= tail ? head - tail : _slots + head - tail;
+}
+#endif